@@ -0,0 +1,384 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include <Pothos/Init.hpp>
+#include <Pothos/Framework.hpp>
+#include <Pothos/Proxy.hpp>
+#include <Pothos/Exception.hpp>
+#include <Poco/NumberParser.h>
+#include <Poco/StringTokenizer.h>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <map>
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <json.hpp>
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Throughput and latency benchmark for the OpenCL blocks:
+ * Sweeps device, dtype, buffer size, number of input ports,
+ * local size, and chain length of back-to-back opencl_kernel blocks.
+ * The results are printed as a JSON array for regression tracking.
+ **********************************************************************/
+static long long nowNs(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/***********************************************************************
+ * Source block: produces every available output buffer
+ * and marks each one with a timestamp label
+ **********************************************************************/
+class BenchSource : public Pothos::Block
+{
+public:
+    BenchSource(const std::string &dtype)
+    {
+        this->setupOutput(0, dtype);
+    }
+
+    void work(void)
+    {
+        auto outPort = this->output(0);
+        const auto N = outPort->elements();
+        if (N == 0) return;
+        outPort->postLabel(Pothos::Label("t", nowNs(), 0));
+        outPort->produce(N);
+    }
+};
+
+/***********************************************************************
+ * Sink block: counts elements and records the label latencies
+ **********************************************************************/
+class BenchSink : public Pothos::Block
+{
+public:
+    BenchSink(const std::string &dtype):
+        _numElements(0)
+    {
+        this->setupInput(0, dtype);
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        const auto N = inPort->elements();
+        if (N == 0) return;
+
+        const auto now = nowNs();
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto &label : inPort->labels())
+        {
+            if (label.index >= N or label.id != "t") continue;
+            _latencies.push_back((now-label.data.convert<long long>())/1e3);
+        }
+        _numElements += N;
+        inPort->consume(N);
+    }
+
+    void reset(void)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _numElements = 0;
+        _latencies.clear();
+    }
+
+    void snapshot(unsigned long long &numElements, std::vector<double> &latencies)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        numElements = _numElements;
+        latencies = _latencies;
+    }
+
+private:
+    std::mutex _mutex;
+    unsigned long long _numElements;
+    std::vector<double> _latencies;
+};
+
+/***********************************************************************
+ * Benchmark configuration
+ **********************************************************************/
+struct BenchDType
+{
+    const char *name; //Pothos dtype name
+    const char *clType; //OpenCL C type name
+};
+
+static const BenchDType BENCH_DTYPES[] = {
+    {"float32", "float"},
+    {"int16", "short"},
+    {"int32", "int"},
+    {"complex_float32", "float2"},
+};
+
+static const BenchDType &lookupBenchDType(const std::string &name)
+{
+    for (const auto &dtype : BENCH_DTYPES)
+    {
+        if (name == dtype.name) return dtype;
+    }
+    throw Pothos::InvalidArgumentException("lookupBenchDType("+name+")", "unsupported dtype");
+}
+
+static std::string makeKernelSource(const BenchDType &dtype, const size_t numPorts)
+{
+    //bench_sum adds all inputs, bench_copy is used for the rest of the chain
+    std::ostringstream ss;
+    ss << "__kernel void bench_sum(\n";
+    for (size_t i = 0; i < numPorts; i++)
+    {
+        ss << "    __global const " << dtype.clType << "* in" << i << ",\n";
+    }
+    ss << "    __global " << dtype.clType << "* out\n";
+    ss << ")\n{\n";
+    ss << "    const uint i = get_global_id(0);\n";
+    ss << "    out[i] = in0[i]";
+    for (size_t i = 1; i < numPorts; i++) ss << " + in" << i << "[i]";
+    ss << ";\n}\n\n";
+    ss << "__kernel void bench_copy(\n";
+    ss << "    __global const " << dtype.clType << "* in,\n";
+    ss << "    __global " << dtype.clType << "* out\n";
+    ss << ")\n{\n";
+    ss << "    const uint i = get_global_id(0);\n";
+    ss << "    out[i] = in[i];\n";
+    ss << "}\n";
+    return ss.str();
+}
+
+static std::vector<std::string> splitList(const std::string &value)
+{
+    std::vector<std::string> result;
+    const Poco::StringTokenizer tok(value, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+    for (const auto &item : tok) result.push_back(item);
+    return result;
+}
+
+static std::vector<size_t> splitSizes(const std::string &value)
+{
+    std::vector<size_t> result;
+    for (const auto &item : splitList(value)) result.push_back(Poco::NumberParser::parseUnsigned(item));
+    return result;
+}
+
+//all devices on all platforms as platform:device markup
+static std::vector<std::string> enumerateDevices(void)
+{
+    std::vector<std::string> devices;
+    cl_uint numPlatforms = 0;
+    if (clGetPlatformIDs(0, nullptr, &numPlatforms) < 0 or numPlatforms == 0) return devices;
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    clGetPlatformIDs(numPlatforms, platforms.data(), nullptr);
+    for (size_t p = 0; p < platforms.size(); p++)
+    {
+        cl_uint numDevices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices) < 0) continue;
+        for (size_t d = 0; d < numDevices; d++)
+        {
+            devices.push_back(std::to_string(p)+":"+std::to_string(d));
+        }
+    }
+    return devices;
+}
+
+static std::string getDeviceName(const std::string &deviceId)
+{
+    const auto colon = deviceId.find(":");
+    const auto platformIndex = Poco::NumberParser::parseUnsigned(deviceId.substr(0, colon));
+    const auto deviceIndex = Poco::NumberParser::parseUnsigned(deviceId.substr(colon+1));
+
+    cl_uint numPlatforms = 0;
+    clGetPlatformIDs(0, nullptr, &numPlatforms);
+    if (platformIndex >= numPlatforms) return "";
+    std::vector<cl_platform_id> platforms(numPlatforms);
+    clGetPlatformIDs(numPlatforms, platforms.data(), nullptr);
+
+    cl_uint numDevices = 0;
+    clGetDeviceIDs(platforms[platformIndex], CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices);
+    if (deviceIndex >= numDevices) return "";
+    std::vector<cl_device_id> devices(numDevices);
+    clGetDeviceIDs(platforms[platformIndex], CL_DEVICE_TYPE_ALL, numDevices, devices.data(), nullptr);
+
+    char name[1024];
+    if (clGetDeviceInfo(devices[deviceIndex], CL_DEVICE_NAME, sizeof(name), name, nullptr) < 0) return "";
+    return name;
+}
+
+struct BenchConfig
+{
+    std::string deviceId;
+    const BenchDType *dtype;
+    size_t bufferSize;
+    size_t numPorts;
+    size_t localSize;
+    size_t chainLength;
+};
+
+/***********************************************************************
+ * Run a single benchmark configuration
+ **********************************************************************/
+static json runBenchmark(const BenchConfig &config, const double warmup, const double duration)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    const auto source = makeKernelSource(*config.dtype, config.numPorts);
+    const std::vector<std::string> clType(1, config.dtype->clType);
+
+    std::vector<std::shared_ptr<Pothos::Block>> sources;
+    for (size_t i = 0; i < config.numPorts; i++)
+    {
+        sources.emplace_back(new BenchSource(config.dtype->name));
+    }
+    std::shared_ptr<BenchSink> sink(new BenchSink(config.dtype->name));
+
+    std::vector<Pothos::Proxy> kernels;
+    for (size_t i = 0; i < config.chainLength; i++)
+    {
+        const std::vector<std::string> inputTypes((i == 0)?config.numPorts:1, config.dtype->clType);
+        auto kernel = registry.call("/blocks/opencl_kernel", config.deviceId, inputTypes, clType);
+        kernel.call("setSource", (i == 0)?"bench_sum":"bench_copy", source);
+        kernel.call("setLocalSize", config.localSize);
+        kernel.call("setBufferSize", config.bufferSize);
+        kernels.push_back(kernel);
+    }
+
+    unsigned long long numElements = 0;
+    std::vector<double> latencies;
+    {
+        Pothos::Topology topology;
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            topology.connect(sources[i], 0, kernels.front(), i);
+        }
+        for (size_t i = 1; i < kernels.size(); i++)
+        {
+            topology.connect(kernels[i-1], 0, kernels[i], 0);
+        }
+        topology.connect(kernels.back(), 0, std::static_pointer_cast<Pothos::Block>(sink), 0);
+        topology.commit();
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(warmup));
+        sink->reset();
+        std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+        sink->snapshot(numElements, latencies);
+
+        topology.disconnectAll();
+        topology.commit();
+    }
+
+    json result;
+    result["device"] = config.deviceId;
+    result["deviceName"] = getDeviceName(config.deviceId);
+    result["dtype"] = config.dtype->name;
+    result["bufferSize"] = config.bufferSize;
+    result["numPorts"] = config.numPorts;
+    result["localSize"] = config.localSize;
+    result["chainLength"] = config.chainLength;
+    result["samplesPerSecond"] = numElements/duration;
+
+    auto &latencyUs = result["latencyUs"];
+    latencyUs["count"] = latencies.size();
+    if (not latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        double total = 0.0;
+        for (const auto latency : latencies) total += latency;
+        latencyUs["mean"] = total/latencies.size();
+        latencyUs["p99"] = latencies[std::min(latencies.size()-1, size_t(latencies.size()*0.99))];
+    }
+    return result;
+}
+
+/***********************************************************************
+ * Command line entry point
+ **********************************************************************/
+static void printUsage(const char *name)
+{
+    std::cout << "Usage: " << name << " [--option=value]..." << std::endl;
+    std::cout << "  --devices=0:0,1:0      Platform:device list (default: all devices)" << std::endl;
+    std::cout << "  --dtypes=float32       Comma list of float32, int16, int32, complex_float32" << std::endl;
+    std::cout << "  --bufferSizes=0        Comma list of buffer sizes in bytes (0 = default)" << std::endl;
+    std::cout << "  --ports=1,2            Comma list of input port counts" << std::endl;
+    std::cout << "  --localSizes=0         Comma list of local sizes (0 = automatic)" << std::endl;
+    std::cout << "  --chainLengths=1,4     Comma list of back-to-back kernel counts" << std::endl;
+    std::cout << "  --warmup=0.5           Seconds to run before measuring" << std::endl;
+    std::cout << "  --duration=2.0         Seconds to measure each configuration" << std::endl;
+    std::cout << "  --output=results.json  Write the results to a file (default: stdout)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::map<std::string, std::string> options;
+    options["dtypes"] = "float32";
+    options["bufferSizes"] = "0";
+    options["ports"] = "1,2";
+    options["localSizes"] = "0";
+    options["chainLengths"] = "1,4";
+    options["warmup"] = "0.5";
+    options["duration"] = "2.0";
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        const auto equals = arg.find("=");
+        if (arg.compare(0, 2, "--") != 0 or equals == std::string::npos)
+        {
+            printUsage(argv[0]);
+            return (arg == "--help")?EXIT_SUCCESS:EXIT_FAILURE;
+        }
+        options[arg.substr(2, equals-2)] = arg.substr(equals+1);
+    }
+
+    try
+    {
+        Pothos::ScopedInit init;
+
+        const auto devices = options.count("devices")?splitList(options.at("devices")):enumerateDevices();
+        if (devices.empty()) throw Pothos::Exception("OpenClBenchmark", "no OpenCL devices found");
+        std::vector<const BenchDType *> dtypes;
+        for (const auto &name : splitList(options.at("dtypes"))) dtypes.push_back(&lookupBenchDType(name));
+        const auto bufferSizes = splitSizes(options.at("bufferSizes"));
+        const auto ports = splitSizes(options.at("ports"));
+        const auto localSizes = splitSizes(options.at("localSizes"));
+        const auto chainLengths = splitSizes(options.at("chainLengths"));
+        const auto warmup = Poco::NumberParser::parseFloat(options.at("warmup"));
+        const auto duration = Poco::NumberParser::parseFloat(options.at("duration"));
+        if (duration <= 0.0) throw Pothos::InvalidArgumentException("OpenClBenchmark", "duration must be positive");
+
+        json results = json::array();
+        for (const auto &deviceId : devices)
+        for (const auto dtype : dtypes)
+        for (const auto bufferSize : bufferSizes)
+        for (const auto numPorts : ports)
+        for (const auto localSize : localSizes)
+        for (const auto chainLength : chainLengths)
+        {
+            if (numPorts == 0 or chainLength == 0) continue;
+            const BenchConfig config = {deviceId, dtype, bufferSize, numPorts, localSize, chainLength};
+            const auto result = runBenchmark(config, warmup, duration);
+            std::cerr << result.dump() << std::endl;
+            results.push_back(result);
+        }
+
+        if (options.count("output") == 0) std::cout << results.dump(4) << std::endl;
+        else std::ofstream(options.at("output")) << results.dump(4) << std::endl;
+    }
+    catch (const Pothos::Exception &ex)
+    {
+        std::cerr << ex.displayText() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
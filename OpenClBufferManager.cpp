@@ -5,45 +5,359 @@
 #include <Pothos/Plugin.hpp>
 #include <Pothos/Util/RingDeque.hpp>
 #include <Pothos/Framework/BufferManager.hpp>
+#include <algorithm>
 #include <cassert>
+#include <deque>
+#include <vector>
+#include <map>
+#include <mutex>
 #include <iostream>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX //std::min and std::max
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 /***********************************************************************
- * The OpenClBufferContainer allocates and maps a buffer.
- * It knows how to cleanup when the buffer dereferences.
+ * The OpenClBufferArena allocates one large buffer and maps it once.
+ * Containers carve it into aligned pieces with sub-buffers.
+ * Device resident arenas (no map flags, read and write by kernels) are
+ * never accessed by the host and are not mapped: a reservation of
+ * inaccessible address space, which commits no memory, gives their
+ * containers unique addresses for slicing.
  **********************************************************************/
-class OpenClBufferContainer
+static void *reserveAddressSpace(const size_t size)
+{
+#ifdef _WIN32
+    void *addr = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+    if (addr == nullptr) throw Pothos::Exception("OpenClBufferArena::VirtualAlloc()", "reservation failed");
+#else
+    void *addr = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) throw Pothos::Exception("OpenClBufferArena::mmap()", "reservation failed");
+#endif
+    return addr;
+}
+
+static void releaseAddressSpace(void *addr, const size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(addr, 0, MEM_RELEASE);
+#else
+    munmap(addr, size);
+#endif
+}
+
+class OpenClBufferArena
 {
 public:
-    OpenClBufferContainer(const OpenClBufferContainerArgs &clArgs, const size_t bufferSize):
-        _clArgs(clArgs)
+    OpenClBufferArena(const OpenClBufferContainerArgs &clArgs, const size_t arenaSize):
+        size(arenaSize),
+        mapped_ptr(nullptr),
+        _clArgs(clArgs),
+        _addressSpace(nullptr)
     {
+        _clArgs.profiler.reset(); //not used by the arena, dont hold it while idle
+        _clArgs.arenaPool.reset(); //the pool holds idle arenas, not the other way around
         cl_int err = 0;
-        memobj = clCreateBuffer(*_clArgs.context, _clArgs.mem_flags, bufferSize, nullptr, &err);
-        if (err < 0) throw Pothos::Exception("OpenClBufferContainer::clCreateBuffer()", clErrToStr(err));
+        memobj = clCreateBuffer(*_clArgs.context, _clArgs.mem_flags, size, nullptr, &err);
+        if (err < 0) throw Pothos::Exception("OpenClBufferArena::clCreateBuffer()", clErrToStr(err));
+
+        if (this->isResident())
+        {
+            try {_addressSpace = reserveAddressSpace(size);}
+            catch (...)
+            {
+                clReleaseMemObject(memobj);
+                throw;
+            }
+            return;
+        }
+
         mapped_ptr = clEnqueueMapBuffer(
             *_clArgs.queue,
             memobj,
             CL_TRUE, /*blocking map*/
             _clArgs.map_flags,
             0, //offset
-            bufferSize,
+            size,
             0, nullptr, nullptr,
             &err);
-        if (err < 0) throw Pothos::Exception("OpenClBufferContainer::clEnqueueMapBuffer()", clErrToStr(err));
+        if (err < 0)
+        {
+            clReleaseMemObject(memobj);
+            throw Pothos::Exception("OpenClBufferArena::clEnqueueMapBuffer()", clErrToStr(err));
+        }
     }
 
-    ~OpenClBufferContainer(void)
+    ~OpenClBufferArena(void)
     {
-        clEnqueueUnmapMemObject(*_clArgs.queue, memobj, mapped_ptr, 0, nullptr, nullptr);
+        if (mapped_ptr != nullptr) clEnqueueUnmapMemObject(*_clArgs.queue, memobj, mapped_ptr, 0, nullptr, nullptr);
+        if (_addressSpace != nullptr) releaseAddressSpace(_addressSpace, size);
         clReleaseMemObject(memobj);
     }
 
+    bool matches(const OpenClBufferContainerArgs &clArgs, const size_t arenaSize) const
+    {
+        return size == arenaSize and
+            _clArgs.context == clArgs.context and
+            _clArgs.queue == clArgs.queue and
+            _clArgs.mem_flags == clArgs.mem_flags and
+            _clArgs.map_flags == clArgs.map_flags;
+    }
+
+    cl_map_flags mapFlags(void) const
+    {
+        return _clArgs.map_flags;
+    }
+
+    void *hostAddress(void) const
+    {
+        return this->isResident()?_addressSpace:mapped_ptr;
+    }
+
+    const size_t size;
     void *mapped_ptr;
     cl_mem memobj;
 
 private:
+    bool isResident(void) const
+    {
+        return _clArgs.map_flags == 0 and _clArgs.mem_flags == CL_MEM_READ_WRITE;
+    }
+
     OpenClBufferContainerArgs _clArgs;
+    void *_addressSpace;
+};
+
+/***********************************************************************
+ * Idle arenas are kept for reuse when the topology is re-committed.
+ * There is one pool per context and queue, held by the blocks and
+ * buffer managers that use them, so the idle arenas are released with
+ * the last of those, while the context and queue are still alive.
+ **********************************************************************/
+static const size_t MAX_IDLE_ARENAS = 32;
+
+class OpenClArenaPool : public std::enable_shared_from_this<OpenClArenaPool>
+{
+public:
+    OpenClArenaPool(const std::shared_ptr<cl_context> &context, const std::shared_ptr<cl_command_queue> &queue):
+        _context(context),
+        _queue(queue)
+    {
+        return;
+    }
+
+    std::shared_ptr<OpenClBufferArena> acquire(const OpenClBufferContainerArgs &clArgs, const size_t arenaSize)
+    {
+        //the last container of an arena returns it to the idle list, if the pool still exists
+        std::weak_ptr<OpenClArenaPool> weakPool(this->shared_from_this());
+        const auto recycle = [weakPool](OpenClBufferArena *arena)
+        {
+            std::unique_ptr<OpenClBufferArena> arenaPtr(arena);
+            auto pool = weakPool.lock();
+            if (not pool) return;
+            std::lock_guard<std::mutex> lock(pool->_mutex);
+            pool->_idleArenas.push_back(std::move(arenaPtr));
+            if (pool->_idleArenas.size() > MAX_IDLE_ARENAS) pool->_idleArenas.pop_front();
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto it = _idleArenas.begin(); it != _idleArenas.end(); ++it)
+            {
+                if (not (*it)->matches(clArgs, arenaSize)) continue;
+                std::shared_ptr<OpenClBufferArena> arena(it->release(), recycle);
+                _idleArenas.erase(it);
+                return arena;
+            }
+        }
+        return std::shared_ptr<OpenClBufferArena>(new OpenClBufferArena(clArgs, arenaSize), recycle);
+    }
+
+private:
+    std::mutex _mutex;
+    std::deque<std::unique_ptr<OpenClBufferArena>> _idleArenas;
+
+    //held so that the context and queue handles of the key are not reused while the pool exists
+    std::shared_ptr<cl_context> _context;
+    std::shared_ptr<cl_command_queue> _queue;
+};
+
+std::shared_ptr<OpenClArenaPool> lookupOpenClArenaPool(
+    const std::shared_ptr<cl_context> &context,
+    const std::shared_ptr<cl_command_queue> &queue)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<cl_context, cl_command_queue>, std::weak_ptr<OpenClArenaPool>> pools;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    //the map only holds weak references, expired pools are removed here
+    for (auto it = pools.begin(); it != pools.end();)
+    {
+        if (it->second.expired()) it = pools.erase(it);
+        else ++it;
+    }
+
+    auto &weakPool = pools[std::make_pair(*context, *queue)];
+    auto pool = weakPool.lock();
+    if (pool) return pool;
+    pool = std::make_shared<OpenClArenaPool>(context, queue);
+    weakPool = pool;
+    return pool;
+}
+
+static std::shared_ptr<OpenClBufferArena> acquireArena(const OpenClBufferContainerArgs &clArgs, const size_t arenaSize)
+{
+    if (clArgs.arenaPool) return clArgs.arenaPool->acquire(clArgs, arenaSize);
+    return std::make_shared<OpenClBufferArena>(clArgs, arenaSize);
+}
+
+/***********************************************************************
+ * The OpenClBufferContainer holds a sub-buffer of an arena,
+ * the device side of a circular buffer, a buffer around host memory
+ * on a unified memory device, or a shared virtual memory buffer.
+ * It knows how to cleanup when the buffer dereferences.
+ **********************************************************************/
+class OpenClBufferContainer
+{
+public:
+    OpenClBufferContainer(const std::shared_ptr<OpenClBufferArena> &arena, const size_t offset, const size_t bufferSize):
+        svm_ptr(nullptr),
+        svmFineGrain(false),
+        mapSize(0),
+        hostMapped(false),
+        ringSize(0),
+        hostValid(arena->mapFlags() == CL_MAP_WRITE),
+        _storage(arena)
+    {
+        cl_int err = 0;
+        cl_buffer_region region;
+        region.origin = offset;
+        region.size = bufferSize;
+        memobj = clCreateSubBuffer(arena->memobj, 0/*inherit flags*/, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+        if (err < 0) throw Pothos::Exception("OpenClBufferContainer::clCreateSubBuffer()", clErrToStr(err));
+        mapped_ptr = static_cast<char *>(arena->hostAddress()) + offset;
+    }
+
+    OpenClBufferContainer(const OpenClBufferContainerArgs &clArgs, const Pothos::SharedBuffer &hostRing):
+        svm_ptr(nullptr),
+        svmFineGrain(false),
+        mapSize(0),
+        hostMapped(false),
+        ringSize(hostRing.getLength()),
+        hostValid(true),
+        _storage(hostRing.getContainer())
+    {
+        //twice the ring size so that any window up to the ring size is contiguous
+        cl_int err = 0;
+        memobj = clCreateBuffer(*clArgs.context, clArgs.mem_flags, 2*ringSize, nullptr, &err);
+        if (err < 0) throw Pothos::Exception("OpenClBufferContainer::clCreateBuffer()", clErrToStr(err));
+        mapped_ptr = reinterpret_cast<void *>(hostRing.getAddress());
+    }
+
+    OpenClBufferContainer(const OpenClBufferContainerArgs &clArgs, void *hostPtr, const size_t bufferSize, const std::shared_ptr<void> &storage):
+        mapped_ptr(hostPtr),
+        svm_ptr(nullptr),
+        svmFineGrain(false),
+        mapSize(bufferSize),
+        hostMapped(false),
+        ringSize(0),
+        hostValid(clArgs.map_flags == CL_MAP_WRITE),
+        _storage(storage),
+        _unmapQueue(clArgs.queue)
+    {
+        //the device accesses the host memory in place, maps return hostPtr
+        cl_int err = 0;
+        memobj = clCreateBuffer(*clArgs.context, clArgs.mem_flags | CL_MEM_USE_HOST_PTR, bufferSize, hostPtr, &err);
+        if (err < 0) throw Pothos::Exception("OpenClBufferContainer::clCreateBuffer()", clErrToStr(err));
+    }
+
+#ifdef CL_VERSION_2_0
+    OpenClBufferContainer(const OpenClBufferContainerArgs &clArgs, const size_t bufferSize, const bool fineGrain):
+        memobj(nullptr),
+        svmFineGrain(fineGrain),
+        mapSize(bufferSize),
+        hostMapped(false),
+        ringSize(0),
+        hostValid(fineGrain),
+        _unmapQueue(clArgs.queue),
+        _svmContext(clArgs.context)
+    {
+        const cl_svm_mem_flags flags = CL_MEM_READ_WRITE | (fineGrain?CL_MEM_SVM_FINE_GRAIN_BUFFER:0);
+        svm_ptr = clSVMAlloc(*_svmContext, flags, bufferSize, 0/*default alignment*/);
+        if (svm_ptr == nullptr) throw Pothos::Exception("OpenClBufferContainer::clSVMAlloc()", "allocation failed");
+        mapped_ptr = svm_ptr;
+    }
+#endif
+
+    ~OpenClBufferContainer(void)
+    {
+        if (memobj != nullptr and hostMapped and _unmapQueue) clEnqueueUnmapMemObject(*_unmapQueue, memobj, mapped_ptr, 0, nullptr, nullptr);
+        if (memobj != nullptr) clReleaseMemObject(memobj);
+#ifdef CL_VERSION_2_0
+        if (svm_ptr != nullptr) this->freeSvm();
+#endif
+    }
+
+    void *mapped_ptr;
+    cl_mem memobj;
+
+    //shared virtual memory is bound by pointer instead of memobj
+    void *svm_ptr;
+    bool svmFineGrain;
+
+    //zero copy buffers are mapped while the host accesses them
+    size_t mapSize;
+    bool hostMapped;
+
+    //non-zero when the device buffer is addressed modulo the ring size
+    const size_t ringSize;
+
+    //true when the host memory holds the contents (buffers uploaded from the host)
+    const bool hostValid;
+
+    //the last command to write memobj, consumers wait on it
+    std::shared_ptr<cl_event> event;
+
+    //the last kernel to read the wrapped bytes past the end of the ring,
+    //the next wrap waits on it before overwriting them
+    std::shared_ptr<cl_event> wrapReader;
+
+private:
+#ifdef CL_VERSION_2_0
+    void freeSvm(void)
+    {
+        //a coarse-grained buffer still mapped by the host is unmapped first,
+        //and the free is enqueued after the last command on the buffer
+        std::vector<cl_event> waitList;
+        if (event) waitList.push_back(*event);
+        cl_event unmapEvent = nullptr;
+        if (hostMapped and not svmFineGrain and clEnqueueSVMUnmap(*_unmapQueue, svm_ptr,
+            waitList.size(), waitList.empty()?nullptr:waitList.data(), &unmapEvent) == CL_SUCCESS)
+        {
+            waitList.assign(1, unmapEvent);
+        }
+        void *svmPointers[] = {svm_ptr};
+        const cl_int err = clEnqueueSVMFree(*_unmapQueue, 1, svmPointers, nullptr, nullptr,
+            waitList.size(), waitList.empty()?nullptr:waitList.data(), nullptr);
+        if (unmapEvent != nullptr) clReleaseEvent(unmapEvent);
+
+        //the free could not be enqueued, wait for the queue to drain instead
+        if (err < 0)
+        {
+            clFinish(*_unmapQueue);
+            clSVMFree(*_svmContext, svm_ptr);
+        }
+    }
+#endif
+
+    std::shared_ptr<void> _storage; //keeps the memory behind mapped_ptr
+    std::shared_ptr<cl_command_queue> _unmapQueue;
+    std::shared_ptr<cl_context> _svmContext;
 };
 
 /***********************************************************************
@@ -64,9 +378,18 @@ public:
     {
         Pothos::BufferManager::init(args);
         _readyBuffs.set_capacity(args.numBuffers);
+
+        //sub-buffer origins must be aligned to the device base address alignment
+        cl_uint alignBits = 0;
+        const cl_int err = clGetDeviceInfo(_clArgs.device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(alignBits), &alignBits, nullptr);
+        if (err < 0) throw Pothos::Exception("OpenClBufferManager::clGetDeviceInfo()", clErrToStr(err));
+        const size_t align = std::max<size_t>(alignBits/8, 1);
+        const size_t stride = ((args.bufferSize+align-1)/align)*align;
+
+        auto arena = acquireArena(_clArgs, stride*args.numBuffers);
         for (size_t i = 0; i < args.numBuffers; i++)
         {
-            auto container = std::make_shared<OpenClBufferContainer>(_clArgs, args.bufferSize);
+            auto container = std::make_shared<OpenClBufferContainer>(arena, i*stride, args.bufferSize);
             auto sharedBuff = Pothos::SharedBuffer(size_t(container->mapped_ptr), args.bufferSize, container);
             Pothos::ManagedBuffer buffer;
             buffer.reset(this->shared_from_this(), sharedBuff);
@@ -90,16 +413,20 @@ public:
         assert(container);
 
         //perform non blocking write
-        //kernel will be enqueued after this
+        //kernel will be enqueued after this and waits on the event
+        container->event.reset();
         if (_clArgs.map_flags == CL_MAP_WRITE)
         {
+            cl_event event;
             const cl_int err = clEnqueueWriteBuffer(
                 *_clArgs.queue,
                 container->memobj, CL_FALSE, 0,
                 numBytes, container->mapped_ptr,
-                0, nullptr, nullptr
+                0, nullptr, &event
             );
             if (err < 0) throw Pothos::Exception("OpenClBufferManager::clEnqueueWriteBuffer()", clErrToStr(err));
+            container->event.reset(new cl_event(event), clReleaseEventPtr);
+            if (_clArgs.profiler) _clArgs.profiler->record(OpenClProfiler::UPLOAD, container->event, numBytes);
         }
 
         //perform blocking read
@@ -130,12 +457,457 @@ private:
     OpenClBufferContainerArgs _clArgs;
 };
 
+/***********************************************************************
+ * Circular buffer manager: the host side is a double mapped ring,
+ * and the device buffer is twice the ring size. Each upload is written
+ * once to its offset in the ring, wrapping to the start of the ring.
+ * The second half is scratch space: when a kernel reads a window that
+ * wraps around the end of the ring, enqueueClRingWrap() copies the
+ * wrapped bytes on the device to just past the end of the ring,
+ * so the window is contiguous without uploading any byte twice.
+ * On out of order queues, each copy also waits on the kernel that read
+ * the previous wrap, since it overwrites the same scratch space.
+ * Buffers must be returned in the order that they were popped.
+ **********************************************************************/
+class OpenClCircularBufferManager :
+    public Pothos::BufferManager,
+    public std::enable_shared_from_this<OpenClCircularBufferManager>
+{
+public:
+    OpenClCircularBufferManager(const OpenClBufferContainerArgs &clArgs):
+        _clArgs(clArgs),
+        _frontAddress(0),
+        _bytesAvailable(0)
+    {
+        return;
+    }
+
+    void init(const Pothos::BufferManagerArgs &args)
+    {
+        Pothos::BufferManager::init(args);
+        _readyBuffs.set_capacity(args.numBuffers);
+        _bytesPopped.set_capacity(args.numBuffers);
+
+        auto hostRing = Pothos::SharedBuffer::makeCirc(args.bufferSize*args.numBuffers, args.nodeAffinity);
+        _ring = std::make_shared<OpenClBufferContainer>(_clArgs, hostRing);
+        _ringBuff = Pothos::SharedBuffer(hostRing.getAddress(), hostRing.getLength(), _ring);
+        _frontAddress = _ringBuff.getAddress();
+        _bytesAvailable = _ringBuff.getLength();
+
+        for (size_t i = 0; i < args.numBuffers; i++)
+        {
+            Pothos::ManagedBuffer buffer;
+            buffer.reset(this->shared_from_this(), _ringBuff, i/*slabIndex*/);
+        }
+    }
+
+    bool empty(void) const
+    {
+        return _readyBuffs.empty() or _bytesAvailable == 0;
+    }
+
+    void pop(const size_t numBytes)
+    {
+        assert(not _readyBuffs.empty());
+        assert(numBytes <= _bytesAvailable);
+        this->setFrontBuffer(Pothos::BufferChunk::null());
+        _readyBuffs.pop_front();
+        _bytesPopped.push_back(numBytes);
+
+        //the upload up to the end of the ring, and the rest to the start of the ring
+        const auto src = reinterpret_cast<const char *>(_frontAddress);
+        const size_t offset = _frontAddress - _ringBuff.getAddress();
+        const size_t endBytes = std::min(numBytes, _ring->ringSize - offset);
+        this->enqueueWrite(offset, endBytes, src);
+        if (endBytes < numBytes) this->enqueueWrite(0, numBytes-endBytes, src+endBytes);
+
+        _bytesAvailable -= numBytes;
+        _frontAddress += numBytes;
+        if (_frontAddress >= _ringBuff.getEnd()) _frontAddress -= _ringBuff.getLength();
+        this->updateFront();
+    }
+
+    void push(const Pothos::ManagedBuffer &buff)
+    {
+        assert(not _readyBuffs.full());
+        assert(not _bytesPopped.empty());
+        _readyBuffs.push_back(buff);
+        _bytesAvailable += _bytesPopped.front();
+        _bytesPopped.pop_front();
+        this->updateFront();
+    }
+
+private:
+    void updateFront(void)
+    {
+        if (this->empty()) return this->setFrontBuffer(Pothos::BufferChunk::null());
+
+        //the front spans all available bytes, the double mapping keeps it contiguous
+        Pothos::BufferChunk front(_readyBuffs.front());
+        front.address = _frontAddress;
+        front.length = _bytesAvailable;
+        this->setFrontBuffer(front);
+    }
+
+    void enqueueWrite(const size_t offset, const size_t numBytes, const void *src)
+    {
+        //each write waits on the previous one, so the last event implies all earlier writes
+        cl_event event;
+        const cl_int err = clEnqueueWriteBuffer(
+            *_clArgs.queue,
+            _ring->memobj, CL_FALSE, offset,
+            numBytes, src,
+            _ring->event?1:0, _ring->event?_ring->event.get():nullptr, &event
+        );
+        if (err < 0) throw Pothos::Exception("OpenClCircularBufferManager::clEnqueueWriteBuffer()", clErrToStr(err));
+        _ring->event.reset(new cl_event(event), clReleaseEventPtr);
+        if (_clArgs.profiler) _clArgs.profiler->record(OpenClProfiler::UPLOAD, _ring->event, numBytes);
+    }
+
+    OpenClBufferContainerArgs _clArgs;
+    std::shared_ptr<OpenClBufferContainer> _ring;
+    Pothos::SharedBuffer _ringBuff;
+    Pothos::Util::RingDeque<Pothos::ManagedBuffer> _readyBuffs;
+    Pothos::Util::RingDeque<size_t> _bytesPopped;
+    size_t _frontAddress;
+    size_t _bytesAvailable;
+};
+
+/***********************************************************************
+ * Unified memory buffer manager: on devices that share physical memory
+ * with the host, each buffer wraps page aligned host memory with
+ * CL_MEM_USE_HOST_PTR. Ownership moves between the host and the device
+ * with map and unmap, which do not copy on these devices.
+ * Input buffers (CL_MAP_WRITE) are unmapped when popped, and mapped again
+ * when returned. Output buffers (CL_MAP_READ) are mapped by the kernel's
+ * readback, and unmapped when returned. Buffers are first returned by init.
+ **********************************************************************/
+static const size_t UNIFIED_ALIGNMENT = 4096;
+static const size_t UNIFIED_SIZE_MULTIPLE = 64;
+
+class OpenClUnifiedBufferManager :
+    public Pothos::BufferManager,
+    public std::enable_shared_from_this<OpenClUnifiedBufferManager>
+{
+public:
+    OpenClUnifiedBufferManager(const OpenClBufferContainerArgs &clArgs):
+        _clArgs(clArgs)
+    {
+        return;
+    }
+
+    void init(const Pothos::BufferManagerArgs &args)
+    {
+        Pothos::BufferManager::init(args);
+        _readyBuffs.set_capacity(args.numBuffers);
+
+        //drivers only skip the copy for aligned host memory of a whole number of cache lines
+        const size_t allocSize = ((args.bufferSize+UNIFIED_SIZE_MULTIPLE-1)/UNIFIED_SIZE_MULTIPLE)*UNIFIED_SIZE_MULTIPLE;
+        for (size_t i = 0; i < args.numBuffers; i++)
+        {
+            std::shared_ptr<char> storage(new char[allocSize+UNIFIED_ALIGNMENT-1], std::default_delete<char[]>());
+            const size_t hostAddr = ((size_t(storage.get())+UNIFIED_ALIGNMENT-1)/UNIFIED_ALIGNMENT)*UNIFIED_ALIGNMENT;
+            auto container = std::make_shared<OpenClBufferContainer>(_clArgs, reinterpret_cast<void *>(hostAddr), allocSize, storage);
+            auto sharedBuff = Pothos::SharedBuffer(hostAddr, args.bufferSize, container);
+            Pothos::ManagedBuffer buffer;
+            buffer.reset(this->shared_from_this(), sharedBuff);
+        }
+    }
+
+    bool empty(void) const
+    {
+        return _readyBuffs.empty();
+    }
+
+    void pop(const size_t)
+    {
+        assert(not _readyBuffs.empty());
+        auto buff = _readyBuffs.front();
+        _readyBuffs.pop_front();
+        if (_readyBuffs.empty()) this->setFrontBuffer(Pothos::BufferChunk::null());
+        else this->setFrontBuffer(_readyBuffs.front());
+
+        auto container = std::static_pointer_cast<OpenClBufferContainer>(buff.getBuffer().getContainer());
+        assert(container);
+        container->event.reset();
+
+        //the host has written the input, hand it to the device
+        if (_clArgs.map_flags == CL_MAP_WRITE) this->unmapForDevice(*container);
+    }
+
+    void push(const Pothos::ManagedBuffer &buff)
+    {
+        auto container = std::static_pointer_cast<OpenClBufferContainer>(buff.getBuffer().getContainer());
+        assert(container);
+
+        //inputs are mapped for the host to write again, the host is done reading outputs
+        if (_clArgs.map_flags == CL_MAP_WRITE) this->mapForHost(*container);
+        if (_clArgs.map_flags == CL_MAP_READ) this->unmapForDevice(*container);
+
+        if (_readyBuffs.empty()) this->setFrontBuffer(buff);
+        assert(not _readyBuffs.full());
+        _readyBuffs.push_back(buff);
+    }
+
+private:
+    void mapForHost(OpenClBufferContainer &container)
+    {
+        if (container.hostMapped) return;
+        cl_int err = 0;
+        void *ptr = clEnqueueMapBuffer(*_clArgs.queue, container.memobj, CL_TRUE, CL_MAP_WRITE,
+            0, container.mapSize,
+            container.event?1:0, container.event?container.event.get():nullptr, nullptr, &err);
+        if (err < 0) throw Pothos::Exception("OpenClUnifiedBufferManager::clEnqueueMapBuffer()", clErrToStr(err));
+        container.event.reset();
+        container.hostMapped = true;
+        if (ptr != container.mapped_ptr) throw Pothos::Exception("OpenClUnifiedBufferManager::clEnqueueMapBuffer()", "mapped pointer moved");
+    }
+
+    void unmapForDevice(OpenClBufferContainer &container)
+    {
+        if (not container.hostMapped) return;
+        container.hostMapped = false;
+        cl_event event;
+        const cl_int err = clEnqueueUnmapMemObject(*_clArgs.queue, container.memobj, container.mapped_ptr, 0, nullptr, &event);
+        if (err < 0) throw Pothos::Exception("OpenClUnifiedBufferManager::clEnqueueUnmapMemObject()", clErrToStr(err));
+        container.event.reset(new cl_event(event), clReleaseEventPtr);
+    }
+
+    Pothos::Util::RingDeque<Pothos::ManagedBuffer> _readyBuffs;
+    OpenClBufferContainerArgs _clArgs;
+};
+
+/***********************************************************************
+ * Shared virtual memory buffer manager: the host and the device access
+ * the same allocation, so uploads and readbacks do not copy.
+ * Coarse-grained buffers are mapped while the host accesses them,
+ * and unmapped before the device does. Fine-grained buffers need neither.
+ * Input buffers (CL_MAP_WRITE) are unmapped when popped, and mapped again
+ * when returned. Output buffers (CL_MAP_READ) are mapped by the kernel's
+ * readback, and unmapped when returned. Buffers are first returned by init.
+ **********************************************************************/
+#ifdef CL_VERSION_2_0
+class OpenClSvmBufferManager :
+    public Pothos::BufferManager,
+    public std::enable_shared_from_this<OpenClSvmBufferManager>
+{
+public:
+    OpenClSvmBufferManager(const OpenClBufferContainerArgs &clArgs, const bool fineGrain):
+        _clArgs(clArgs),
+        _fineGrain(fineGrain)
+    {
+        return;
+    }
+
+    void init(const Pothos::BufferManagerArgs &args)
+    {
+        Pothos::BufferManager::init(args);
+        _readyBuffs.set_capacity(args.numBuffers);
+        for (size_t i = 0; i < args.numBuffers; i++)
+        {
+            auto container = std::make_shared<OpenClBufferContainer>(_clArgs, args.bufferSize, _fineGrain);
+            auto sharedBuff = Pothos::SharedBuffer(size_t(container->svm_ptr), args.bufferSize, container);
+            Pothos::ManagedBuffer buffer;
+            buffer.reset(this->shared_from_this(), sharedBuff);
+        }
+    }
+
+    bool empty(void) const
+    {
+        return _readyBuffs.empty();
+    }
+
+    void pop(const size_t)
+    {
+        assert(not _readyBuffs.empty());
+        auto buff = _readyBuffs.front();
+        _readyBuffs.pop_front();
+        if (_readyBuffs.empty()) this->setFrontBuffer(Pothos::BufferChunk::null());
+        else this->setFrontBuffer(_readyBuffs.front());
+
+        auto container = std::static_pointer_cast<OpenClBufferContainer>(buff.getBuffer().getContainer());
+        assert(container);
+        container->event.reset();
+
+        //the host has written the input, hand it to the device
+        if (not _fineGrain and _clArgs.map_flags == CL_MAP_WRITE) this->unmapForDevice(*container);
+    }
+
+    void push(const Pothos::ManagedBuffer &buff)
+    {
+        auto container = std::static_pointer_cast<OpenClBufferContainer>(buff.getBuffer().getContainer());
+        assert(container);
+
+        //inputs are mapped for the host to write again, the host is done reading outputs
+        if (not _fineGrain and _clArgs.map_flags == CL_MAP_WRITE) this->mapForHost(*container);
+        if (not _fineGrain and _clArgs.map_flags == CL_MAP_READ) this->unmapForDevice(*container);
+
+        if (_readyBuffs.empty()) this->setFrontBuffer(buff);
+        assert(not _readyBuffs.full());
+        _readyBuffs.push_back(buff);
+    }
+
+private:
+    void mapForHost(OpenClBufferContainer &container)
+    {
+        if (container.hostMapped) return;
+        const cl_int err = clEnqueueSVMMap(*_clArgs.queue, CL_TRUE, CL_MAP_WRITE,
+            container.svm_ptr, container.mapSize,
+            container.event?1:0, container.event?container.event.get():nullptr, nullptr);
+        if (err < 0) throw Pothos::Exception("OpenClSvmBufferManager::clEnqueueSVMMap()", clErrToStr(err));
+        container.event.reset();
+        container.hostMapped = true;
+    }
+
+    void unmapForDevice(OpenClBufferContainer &container)
+    {
+        if (not container.hostMapped) return;
+        container.hostMapped = false;
+        cl_event event;
+        const cl_int err = clEnqueueSVMUnmap(*_clArgs.queue, container.svm_ptr, 0, nullptr, &event);
+        if (err < 0) throw Pothos::Exception("OpenClSvmBufferManager::clEnqueueSVMUnmap()", clErrToStr(err));
+        container.event.reset(new cl_event(event), clReleaseEventPtr);
+    }
+
+    Pothos::Util::RingDeque<Pothos::ManagedBuffer> _readyBuffs;
+    OpenClBufferContainerArgs _clArgs;
+    const bool _fineGrain;
+};
+#endif //CL_VERSION_2_0
+
 Pothos::BufferManager::Sptr makeOpenClBufferManager(const OpenClBufferContainerArgs &args)
 {
     return std::make_shared<OpenClBufferManager>(args);
 }
 
+Pothos::BufferManager::Sptr makeOpenClCircularBufferManager(const OpenClBufferContainerArgs &args)
+{
+    return std::make_shared<OpenClCircularBufferManager>(args);
+}
+
+Pothos::BufferManager::Sptr makeOpenClUnifiedBufferManager(const OpenClBufferContainerArgs &args)
+{
+    cl_bool unified = CL_FALSE;
+    const cl_int err = clGetDeviceInfo(args.device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, nullptr);
+    if (err == 0 and unified == CL_TRUE) return std::make_shared<OpenClUnifiedBufferManager>(args);
+
+    //discrete devices copy between the mapped host memory and the device
+    auto discreteArgs = args;
+    discreteArgs.mem_flags |= CL_MEM_ALLOC_HOST_PTR;
+    if (discreteArgs.map_flags == CL_MAP_READ) discreteArgs.map_flags = 0;
+    return makeOpenClBufferManager(discreteArgs);
+}
+
+Pothos::BufferManager::Sptr makeOpenClSvmBufferManager(const OpenClBufferContainerArgs &args)
+{
+    //devices without SVM support fall back to unified or discrete buffers
+#ifdef CL_VERSION_2_0
+    cl_device_svm_capabilities caps = 0;
+    const cl_int err = clGetDeviceInfo(args.device, CL_DEVICE_SVM_CAPABILITIES, sizeof(caps), &caps, nullptr);
+    if (err == 0 and (caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) != 0)
+    {
+        return std::make_shared<OpenClSvmBufferManager>(args, true);
+    }
+    if (err == 0 and (caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER) != 0)
+    {
+        return std::make_shared<OpenClSvmBufferManager>(args, false);
+    }
+#endif //CL_VERSION_2_0
+    return makeOpenClUnifiedBufferManager(args);
+}
+
 cl_mem &getClBufferFromManaged(const Pothos::ManagedBuffer &buff)
 {
     return std::static_pointer_cast<OpenClBufferContainer>(buff.getBuffer().getContainer())->memobj;
 }
+
+std::shared_ptr<cl_event> &getClEventFromManaged(const Pothos::ManagedBuffer &buff)
+{
+    return std::static_pointer_cast<OpenClBufferContainer>(buff.getBuffer().getContainer())->event;
+}
+
+size_t getClOffsetFromChunk(const Pothos::BufferChunk &chunk)
+{
+    const auto container = std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer());
+    const size_t offset = chunk.address - size_t(container->mapped_ptr);
+    return (container->ringSize == 0)?offset:(offset % container->ringSize);
+}
+
+bool isClHostValidFromChunk(const Pothos::BufferChunk &chunk)
+{
+    return std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer())->hostValid;
+}
+
+bool isClZeroCopyFromChunk(const Pothos::BufferChunk &chunk)
+{
+    return std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer())->mapSize != 0;
+}
+
+void *getClSvmPointerFromChunk(const Pothos::BufferChunk &chunk)
+{
+    const auto container = std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer());
+    if (container->svm_ptr == nullptr) return nullptr;
+    return chunk.as<void *>();
+}
+
+cl_int setClKernelArgSvm(cl_kernel kernel, const cl_uint index, const void *svmPtr)
+{
+#ifdef CL_VERSION_2_0
+    return clSetKernelArgSVMPointer(kernel, index, svmPtr);
+#else
+    return CL_INVALID_OPERATION;
+#endif
+}
+
+cl_int enqueueClRingWrap(cl_command_queue queue, const Pothos::BufferChunk &chunk, const size_t numBytes, std::shared_ptr<cl_event> &event)
+{
+    const auto container = std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer());
+    if (container->ringSize == 0) return CL_SUCCESS;
+    const size_t offset = getClOffsetFromChunk(chunk);
+    if (offset + numBytes <= container->ringSize) return CL_SUCCESS;
+
+    //the wrapped bytes at the start of the ring are copied past its end, the regions dont overlap,
+    //the copy waits on the upload and on the kernel that read the previous wrap from the same place
+    std::vector<cl_event> waitList;
+    if (event) waitList.push_back(*event);
+    if (container->wrapReader) waitList.push_back(*container->wrapReader);
+    cl_event copyEvent;
+    const cl_int err = clEnqueueCopyBuffer(queue, container->memobj, container->memobj,
+        0, container->ringSize, offset + numBytes - container->ringSize,
+        waitList.size(), waitList.empty()?nullptr:waitList.data(), &copyEvent);
+    if (err < 0) return err;
+    event.reset(new cl_event(copyEvent), clReleaseEventPtr);
+    return CL_SUCCESS;
+}
+
+void setClRingWrapReader(const Pothos::BufferChunk &chunk, const std::shared_ptr<cl_event> &event)
+{
+    const auto container = std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer());
+    if (container->ringSize != 0) container->wrapReader = event;
+}
+
+cl_int enqueueClZeroCopyReadback(cl_command_queue queue, const Pothos::BufferChunk &chunk, cl_event waitEvent, cl_event *event)
+{
+    const auto container = std::static_pointer_cast<OpenClBufferContainer>(chunk.getBuffer().getContainer());
+
+    //unified memory buffers are mapped for the host to read at their host pointer
+    if (container->svm_ptr == nullptr)
+    {
+        cl_int err = 0;
+        void *ptr = clEnqueueMapBuffer(queue, container->memobj, CL_FALSE, CL_MAP_READ,
+            0, container->mapSize, 1, &waitEvent, event, &err);
+        if (err < 0) return err;
+        container->hostMapped = true;
+        return (ptr == container->mapped_ptr)?CL_SUCCESS:CL_MAP_FAILURE;
+    }
+
+#ifdef CL_VERSION_2_0
+    //coarse-grained buffers are mapped for the host to read,
+    //fine-grained buffers only need an event for the completion of the kernel
+    if (container->svmFineGrain) return clEnqueueMarkerWithWaitList(queue, 1, &waitEvent, event);
+    container->hostMapped = true;
+    return clEnqueueSVMMap(queue, CL_FALSE, CL_MAP_READ, container->svm_ptr, container->mapSize, 1, &waitEvent, event);
+#else
+    return CL_INVALID_OPERATION;
+#endif
+}
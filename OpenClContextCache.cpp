@@ -4,6 +4,7 @@
 #include "OpenClKernel.hpp"
 #include <Pothos/Exception.hpp>
 #include <mutex>
+#include <tuple>
 #include <map>
 
 std::shared_ptr<cl_context> lookupContextCache(cl_device_id device)
@@ -24,3 +25,32 @@ std::shared_ptr<cl_context> lookupContextCache(cl_device_id device)
     weakContext = contextSptr;
     return contextSptr;
 }
+
+std::shared_ptr<cl_command_queue> makeCommandQueue(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    cl_command_queue_properties properties)
+{
+    cl_int err = 0;
+    auto queue = clCreateCommandQueue(*context, device, properties, &err);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateCommandQueue()", clErrToStr(err));
+    return std::shared_ptr<cl_command_queue>(new cl_command_queue(queue), &clReleaseCommandQueuePtr);
+}
+
+std::shared_ptr<cl_command_queue> lookupQueueCache(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    cl_command_queue_properties properties)
+{
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    //a live queue retains its context, so the context handle in the key
+    //cannot be reused by a new context while the queue is cached
+    static std::map<std::tuple<cl_context, cl_device_id, cl_command_queue_properties>, std::weak_ptr<cl_command_queue>> queueCache;
+    auto &weakQueue = queueCache[std::make_tuple(*context, device, properties)];
+    auto queueSptr = weakQueue.lock();
+    if (not queueSptr) queueSptr = makeCommandQueue(context, device, properties);
+    weakQueue = queueSptr;
+    return queueSptr;
+}
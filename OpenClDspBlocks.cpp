@@ -0,0 +1,585 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include "OpenClKernel.hpp"
+#include <Pothos/Framework.hpp>
+#include <cmath>
+
+/***********************************************************************
+ * Built-in kernels are vectorized: each work-item processes a float4 or
+ * float8 worth of elements with vload/vstore, so the global factor is
+ * the inverse of the elements per work-item. Local sizes are auto-tuned.
+ * The element-wise kernels take the element count of the launch, and the
+ * last work-item processes the remainder one element at a time,
+ * so the tail of the stream is not left behind in the input.
+ * The kernels take no offset arguments, so the buffer mode is discrete.
+ **********************************************************************/
+static const char *COMPLEX_MULTIPLY_SOURCE =
+"__kernel void complex_multiply(\n"
+"    __global const float *in0,\n"
+"    __global const float *in1,\n"
+"    __global float *out,\n"
+"    const uint numElems\n"
+")\n"
+"{\n"
+"    const size_t i = get_global_id(0);\n"
+"    if (4*i+4 > numElems)\n"
+"    {\n"
+"        for (size_t j = 4*i; j < numElems; j++)\n"
+"        {\n"
+"            const float2 a = vload2(j, in0);\n"
+"            const float2 b = vload2(j, in1);\n"
+"            vstore2((float2)(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x), j, out);\n"
+"        }\n"
+"        return;\n"
+"    }\n"
+"    const float8 a = vload8(i, in0);\n"
+"    const float8 b = vload8(i, in1);\n"
+"    const float4 re = a.even*b.even - a.odd*b.odd;\n"
+"    const float4 im = a.even*b.odd + a.odd*b.even;\n"
+"    vstore8(shuffle2(re, im, (uint8)(0, 4, 1, 5, 2, 6, 3, 7)), i, out);\n"
+"}\n";
+
+static const char *MAGNITUDE_SOURCE =
+"#if MODE == 0\n"
+"#define FROM_POWER(p) sqrt(p)\n"
+"#elif MODE == 1\n"
+"#define FROM_POWER(p) (p)\n"
+"#else\n"
+"#define FROM_POWER(p) (10.0f*log10(p))\n"
+"#endif\n"
+"__kernel void magnitude(\n"
+"    __global const float *in,\n"
+"    __global float *out,\n"
+"    const uint numElems\n"
+")\n"
+"{\n"
+"    const size_t i = get_global_id(0);\n"
+"    if (4*i+4 > numElems)\n"
+"    {\n"
+"        for (size_t j = 4*i; j < numElems; j++)\n"
+"        {\n"
+"            const float2 x = vload2(j, in);\n"
+"            out[j] = FROM_POWER(x.x*x.x + x.y*x.y);\n"
+"        }\n"
+"        return;\n"
+"    }\n"
+"    const float8 x = vload8(i, in);\n"
+"    const float4 power = x.even*x.even + x.odd*x.odd;\n"
+"    vstore4(FROM_POWER(power), i, out);\n"
+"}\n";
+
+//the taps are reversed and zero padded at the front to a multiple of 4,
+//so output i is the dot product of the taps with the staged input at i*DECIMATION
+static const char *FIR_DECIMATOR_SOURCE =
+"__kernel void fir_decimator(\n"
+"    __global const float *in,\n"
+"    __global float *out,\n"
+"    __constant float *taps\n"
+")\n"
+"{\n"
+"    const size_t i = get_global_id(0);\n"
+"    const size_t first = i*DECIMATION;\n"
+"#ifdef COMPLEX\n"
+"    float8 acc = (float8)(0.0f);\n"
+"    for (size_t j = 0; j < NUM_TAPS; j += 4)\n"
+"    {\n"
+"        const float4 t = vload4(0, taps+j);\n"
+"        acc += vload8(0, in+2*(first+j))*shuffle(t, (uint8)(0, 0, 1, 1, 2, 2, 3, 3));\n"
+"    }\n"
+"    const float4 re = acc.even;\n"
+"    const float4 im = acc.odd;\n"
+"    vstore2((float2)(re.s0+re.s1+re.s2+re.s3, im.s0+im.s1+im.s2+im.s3), i, out);\n"
+"#else\n"
+"    float4 acc = (float4)(0.0f);\n"
+"    for (size_t j = 0; j < NUM_TAPS; j += 4)\n"
+"    {\n"
+"        acc += vload4(0, in+first+j)*vload4(0, taps+j);\n"
+"    }\n"
+"    out[i] = acc.s0+acc.s1+acc.s2+acc.s3;\n"
+"#endif\n"
+"}\n";
+
+//the phase is a 32-bit fixed point fraction of a cycle, so it wraps exactly
+static const char *FREQ_SHIFT_SOURCE =
+"__kernel void freq_shift(\n"
+"    __global const float *in,\n"
+"    __global float *out,\n"
+"    const uint phase,\n"
+"    const uint step,\n"
+"    const uint numElems\n"
+")\n"
+"{\n"
+"    const size_t i = get_global_id(0);\n"
+"    if (4*i+4 > numElems)\n"
+"    {\n"
+"        for (size_t j = 4*i; j < numElems; j++)\n"
+"        {\n"
+"            const float angle = convert_float(as_int(phase + (uint)j*step))*(M_PI_F/2147483648.0f);\n"
+"            float c;\n"
+"            const float s = sincos(angle, &c);\n"
+"            const float2 x = vload2(j, in);\n"
+"            vstore2((float2)(x.x*c - x.y*s, x.x*s + x.y*c), j, out);\n"
+"        }\n"
+"        return;\n"
+"    }\n"
+"    const uint4 n = (uint4)(0, 1, 2, 3) + (uint)(4*i);\n"
+"    const float4 angle = convert_float4(as_int4(phase + n*step))*(M_PI_F/2147483648.0f);\n"
+"    float4 c;\n"
+"    const float4 s = sincos(angle, &c);\n"
+"    const float8 x = vload8(i, in);\n"
+"    const float4 re = x.even*c - x.odd*s;\n"
+"    const float4 im = x.even*s + x.odd*c;\n"
+"    vstore8(shuffle2(re, im, (uint8)(0, 4, 1, 5, 2, 6, 3, 7)), i, out);\n"
+"}\n";
+
+static const char *CONVERT_SOURCE =
+"__kernel void convert(\n"
+"    __global const IN_TYPE *in,\n"
+"    __global OUT_TYPE *out,\n"
+"    const float scale,\n"
+"    const uint numScalars\n"
+")\n"
+"{\n"
+"    const size_t i = get_global_id(0);\n"
+"    if (8*i+8 > numScalars)\n"
+"    {\n"
+"        for (size_t j = 8*i; j < numScalars; j++) out[j] = OUT_CONVERT_SCALAR(convert_float(in[j])*scale);\n"
+"        return;\n"
+"    }\n"
+"    const float8 x = convert_float8(vload8(i, in))*scale;\n"
+"    vstore8(OUT_CONVERT(x), i, out);\n"
+"}\n";
+
+/***********************************************************************
+ * |PothosDoc OpenCL Complex Multiply
+ *
+ * Multiply two complex float streams element by element on an OpenCL device.
+ * Each work-item multiplies four complex elements as float8 vectors.
+ *
+ * |category /OpenCL
+ * |category /Math
+ * |keywords opencl complex multiply mixer
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |factory /blocks/opencl_complex_multiply(deviceId)
+ **********************************************************************/
+class OpenClComplexMultiply : public OpenClKernel
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId)
+    {
+        return new OpenClComplexMultiply(deviceId);
+    }
+
+    OpenClComplexMultiply(const std::string &deviceId):
+        OpenClKernel(deviceId, std::vector<std::string>(2, "complex_float32"), std::vector<std::string>(1, "complex_float32"))
+    {
+        this->setLocalSize(0);
+        this->setGlobalFactor(0.25);
+        this->setPartialWorkItems(true);
+        this->setSource("complex_multiply", COMPLEX_MULTIPLY_SOURCE);
+    }
+
+protected:
+    void prepareLaunch(const size_t numElems)
+    {
+        this->setScalarArg(3, "uint32", cl_uint(numElems));
+    }
+};
+
+static Pothos::BlockRegistry registerOpenClComplexMultiply(
+    "/blocks/opencl_complex_multiply", &OpenClComplexMultiply::make);
+
+/***********************************************************************
+ * |PothosDoc OpenCL Magnitude
+ *
+ * Compute the magnitude or power of a complex float stream on an OpenCL device.
+ * Each work-item processes four complex elements as a float8 vector.
+ *
+ * |category /OpenCL
+ * |category /Math
+ * |keywords opencl complex magnitude power abs
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |param mode[Mode] The output for each complex element.
+ * <ul>
+ * <li>MAGNITUDE - sqrt(re^2 + im^2)</li>
+ * <li>POWER - re^2 + im^2</li>
+ * <li>POWER_DB - 10*log10(re^2 + im^2)</li>
+ * </ul>
+ * |default "MAGNITUDE"
+ * |option [Magnitude] "MAGNITUDE"
+ * |option [Power] "POWER"
+ * |option [Power dB] "POWER_DB"
+ *
+ * |factory /blocks/opencl_magnitude(deviceId)
+ * |setter setMode(mode)
+ **********************************************************************/
+class OpenClMagnitude : public OpenClKernel
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId)
+    {
+        return new OpenClMagnitude(deviceId);
+    }
+
+    OpenClMagnitude(const std::string &deviceId):
+        OpenClKernel(deviceId, std::vector<std::string>(1, "complex_float32"), std::vector<std::string>(1, "float32"))
+    {
+        this->setLocalSize(0);
+        this->setGlobalFactor(0.25);
+        this->setPartialWorkItems(true);
+        this->setMode("MAGNITUDE");
+        this->setSource("magnitude", MAGNITUDE_SOURCE);
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClMagnitude, setMode));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClMagnitude, getMode));
+    }
+
+    void setMode(const std::string &mode)
+    {
+        Pothos::ObjectKwargs defines;
+        if (mode == "MAGNITUDE") defines["MODE"] = Pothos::Object(std::string("0"));
+        else if (mode == "POWER") defines["MODE"] = Pothos::Object(std::string("1"));
+        else if (mode == "POWER_DB") defines["MODE"] = Pothos::Object(std::string("2"));
+        else throw Pothos::Exception("OpenClMagnitude::setMode("+mode+")", "unknown mode");
+        _mode = mode;
+        this->setDefines(defines);
+    }
+
+    std::string getMode(void) const
+    {
+        return _mode;
+    }
+
+protected:
+    void prepareLaunch(const size_t numElems)
+    {
+        this->setScalarArg(2, "uint32", cl_uint(numElems));
+    }
+
+private:
+    std::string _mode;
+};
+
+static Pothos::BlockRegistry registerOpenClMagnitude(
+    "/blocks/opencl_magnitude", &OpenClMagnitude::make);
+
+/***********************************************************************
+ * |PothosDoc OpenCL FIR Decimator
+ *
+ * A decimating FIR filter with real taps on an OpenCL device.
+ * Each work-item computes one output, accumulating four taps at a time
+ * as float4 (real) or float8 (complex) vectors. The filter history
+ * stays in device memory between launches.
+ *
+ * |category /OpenCL
+ * |category /Filter
+ * |keywords opencl fir filter decimate taps
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |param dtype[Data Type] The data type of the input and output stream.
+ * |widget DTypeChooser(float32=1, cfloat32=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param taps[Taps] The real filter taps.
+ * Setting the taps starts the filter history over with zeros.
+ * |default [1.0]
+ *
+ * |param decimation[Decimation] Produce one output for every decimation inputs.
+ * |default 1
+ *
+ * |factory /blocks/opencl_fir_decimator(deviceId, dtype)
+ * |setter setTaps(taps)
+ * |setter setDecimation(decimation)
+ **********************************************************************/
+class OpenClFirDecimator : public OpenClKernel
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId, const Pothos::DType &dtype)
+    {
+        if (dtype.name() != "float32" and dtype.name() != "complex_float32")
+        {
+            throw Pothos::Exception("OpenClFirDecimator("+dtype.toString()+")", "unsupported type");
+        }
+        return new OpenClFirDecimator(deviceId, dtype);
+    }
+
+    OpenClFirDecimator(const std::string &deviceId, const Pothos::DType &dtype):
+        OpenClKernel(deviceId, std::vector<std::string>(1, dtype.name()), std::vector<std::string>(1, dtype.name())),
+        _complex(dtype.isComplex()),
+        _taps(1, 1.0),
+        _decimation(1)
+    {
+        this->setLocalSize(0);
+        this->updateFilter();
+        this->setSource("fir_decimator", FIR_DECIMATOR_SOURCE);
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFirDecimator, setTaps));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFirDecimator, getTaps));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFirDecimator, setDecimation));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFirDecimator, getDecimation));
+    }
+
+    void setTaps(const std::vector<double> &taps)
+    {
+        if (taps.empty()) throw Pothos::Exception("OpenClFirDecimator::setTaps()", "no taps specified");
+        _taps = taps;
+        this->updateFilter();
+    }
+
+    std::vector<double> getTaps(void) const
+    {
+        return _taps;
+    }
+
+    void setDecimation(const size_t decimation)
+    {
+        if (decimation == 0) throw Pothos::Exception("OpenClFirDecimator::setDecimation()", "decimation must be at least 1");
+        _decimation = decimation;
+        this->updateFilter();
+    }
+
+    size_t getDecimation(void) const
+    {
+        return _decimation;
+    }
+
+private:
+    void updateFilter(void)
+    {
+        //reversed taps, zero padded at the front to a multiple of the vector width
+        const size_t numTaps = ((_taps.size()+3)/4)*4;
+        std::vector<double> padded(numTaps, 0.0);
+        for (size_t k = 0; k < _taps.size(); k++) padded[numTaps-1-k] = _taps[k];
+
+        Pothos::ObjectKwargs defines;
+        defines["NUM_TAPS"] = Pothos::Object(std::to_string(numTaps));
+        defines["DECIMATION"] = Pothos::Object(std::to_string(_decimation));
+        if (_complex) defines["COMPLEX"] = Pothos::Object(std::string());
+
+        //the padded taps and history only match a kernel built with the new defines
+        const size_t decimation = _decimation;
+        this->setDefinesWithLaunchState(defines, [this, padded, numTaps, decimation](void)
+        {
+            this->setConstantArg(2, "float32", padded);
+            this->setHistory(0, numTaps-1);
+            this->setGlobalFactor(1.0/decimation);
+            this->setProductionFactor(1.0/decimation);
+        });
+    }
+
+    const bool _complex;
+    std::vector<double> _taps;
+    size_t _decimation;
+};
+
+static Pothos::BlockRegistry registerOpenClFirDecimator(
+    "/blocks/opencl_fir_decimator", &OpenClFirDecimator::make);
+
+/***********************************************************************
+ * |PothosDoc OpenCL Frequency Shift
+ *
+ * Shift the frequency of a complex float stream on an OpenCL device
+ * by mixing it with a numerically controlled oscillator.
+ * Each work-item mixes four complex elements as float8 vectors.
+ * The oscillator phase is a 32-bit fixed point accumulator,
+ * which stays continuous across launches.
+ *
+ * |category /OpenCL
+ * |category /Math
+ * |keywords opencl frequency shift nco mixer oscillator
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |param frequency[Frequency] The frequency offset.
+ * |unit Hz
+ * |default 0.0
+ *
+ * |param sampleRate[Sample Rate] The sample rate of the stream.
+ * |unit samples/sec
+ * |default 1e6
+ *
+ * |factory /blocks/opencl_freq_shift(deviceId)
+ * |setter setSampleRate(sampleRate)
+ * |setter setFrequency(frequency)
+ **********************************************************************/
+class OpenClFreqShift : public OpenClKernel
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId)
+    {
+        return new OpenClFreqShift(deviceId);
+    }
+
+    OpenClFreqShift(const std::string &deviceId):
+        OpenClKernel(deviceId, std::vector<std::string>(1, "complex_float32"), std::vector<std::string>(1, "complex_float32")),
+        _frequency(0.0),
+        _sampleRate(1.0),
+        _phase(0),
+        _step(0)
+    {
+        this->setLocalSize(0);
+        this->setGlobalFactor(0.25);
+        this->setPartialWorkItems(true);
+        this->updateStep();
+        this->setSource("freq_shift", FREQ_SHIFT_SOURCE);
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFreqShift, setFrequency));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFreqShift, getFrequency));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFreqShift, setSampleRate));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFreqShift, getSampleRate));
+    }
+
+    void setFrequency(const double frequency)
+    {
+        _frequency = frequency;
+        this->updateStep();
+    }
+
+    double getFrequency(void) const
+    {
+        return _frequency;
+    }
+
+    void setSampleRate(const double sampleRate)
+    {
+        if (sampleRate <= 0.0) throw Pothos::Exception("OpenClFreqShift::setSampleRate()", "sample rate must be positive");
+        _sampleRate = sampleRate;
+        this->updateStep();
+    }
+
+    double getSampleRate(void) const
+    {
+        return _sampleRate;
+    }
+
+protected:
+    void prepareLaunch(const size_t numElems)
+    {
+        this->setScalarArg(2, "uint32", _phase);
+        this->setScalarArg(4, "uint32", cl_uint(numElems));
+        _phase = cl_uint(_phase + cl_ulong(numElems)*_step);
+    }
+
+private:
+    void updateStep(void)
+    {
+        //cycles per sample as a fraction of 2^32, negative frequencies wrap around
+        const double cycles = std::fmod(_frequency/_sampleRate, 1.0);
+        _step = cl_uint(cl_long(std::floor(cycles*4294967296.0 + 0.5)));
+        this->setScalarArg(3, "uint32", _step);
+    }
+
+    double _frequency;
+    double _sampleRate;
+    cl_uint _phase;
+    cl_uint _step;
+};
+
+static Pothos::BlockRegistry registerOpenClFreqShift(
+    "/blocks/opencl_freq_shift", &OpenClFreqShift::make);
+
+/***********************************************************************
+ * |PothosDoc OpenCL Convert
+ *
+ * Convert between numeric stream types on an OpenCL device,
+ * with a scale factor applied in floating point.
+ * Integer outputs are rounded and saturated to the range of the type.
+ * Complex types convert to complex types of another element type.
+ * Each work-item converts eight scalar elements as vectors.
+ *
+ * |category /OpenCL
+ * |category /Convert
+ * |keywords opencl convert cast scale
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |param inputType[Input Type] The data type of the input stream.
+ * |widget DTypeChooser(int8=1, int16=1, int32=1, uint8=1, uint16=1, uint32=1, float32=1, cint8=1, cint16=1, cint32=1, cfloat32=1)
+ * |default "complex_int16"
+ * |preview disable
+ *
+ * |param outputType[Output Type] The data type of the output stream.
+ * |widget DTypeChooser(int8=1, int16=1, int32=1, uint8=1, uint16=1, uint32=1, float32=1, cint8=1, cint16=1, cint32=1, cfloat32=1)
+ * |default "complex_float32"
+ * |preview disable
+ *
+ * |param scale[Scale] Multiply each element by this factor before the conversion.
+ * |default 1.0
+ *
+ * |factory /blocks/opencl_convert(deviceId, inputType, outputType)
+ * |setter setScale(scale)
+ **********************************************************************/
+class OpenClConvert : public OpenClKernel
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId, const Pothos::DType &inputType, const Pothos::DType &outputType)
+    {
+        if (inputType.isComplex() != outputType.isComplex())
+        {
+            throw Pothos::Exception("OpenClConvert("+inputType.toString()+", "+outputType.toString()+")", "cannot convert between real and complex");
+        }
+        return new OpenClConvert(deviceId, inputType, outputType);
+    }
+
+    OpenClConvert(const std::string &deviceId, const Pothos::DType &inputType, const Pothos::DType &outputType):
+        OpenClKernel(deviceId, std::vector<std::string>(1, inputType.name()), std::vector<std::string>(1, outputType.name())),
+        _scale(1.0),
+        _scalarsPerElem(inputType.isComplex()?2:1)
+    {
+        const auto inName = clScalarTypeName(inputType);
+        const auto outName = clScalarTypeName(outputType);
+        Pothos::ObjectKwargs defines;
+        defines["IN_TYPE"] = Pothos::Object(inName);
+        defines["OUT_TYPE"] = Pothos::Object(outName);
+        defines["OUT_CONVERT"] = Pothos::Object("convert_"+outName+"8"+((outName == "float")?"":"_sat_rte"));
+        defines["OUT_CONVERT_SCALAR"] = Pothos::Object("convert_"+outName+((outName == "float")?"":"_sat_rte"));
+        this->setDefines(defines);
+
+        //eight scalars per work-item, complex elements are two scalars
+        this->setLocalSize(0);
+        this->setGlobalFactor(inputType.isComplex()?0.25:0.125);
+        this->setPartialWorkItems(true);
+        this->setScale(1.0);
+        this->setSource("convert", CONVERT_SOURCE);
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClConvert, setScale));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClConvert, getScale));
+    }
+
+    void setScale(const double scale)
+    {
+        _scale = scale;
+        this->setScalarArg(2, "float32", _scale);
+    }
+
+    double getScale(void) const
+    {
+        return _scale;
+    }
+
+protected:
+    void prepareLaunch(const size_t numElems)
+    {
+        this->setScalarArg(3, "uint32", cl_uint(numElems*_scalarsPerElem));
+    }
+
+private:
+    double _scale;
+    const size_t _scalarsPerElem;
+};
+
+static Pothos::BlockRegistry registerOpenClConvert(
+    "/blocks/opencl_convert", &OpenClConvert::make);
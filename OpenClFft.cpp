@@ -0,0 +1,228 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include "OpenClKernel.hpp"
+#include <Pothos/Framework.hpp>
+#include <algorithm> //max
+#include <complex>
+
+/***********************************************************************
+ * Batched FFT kernel: each work-group transforms one frame in local memory.
+ * The frame is loaded into local memory, transformed with Stockham autosort
+ * stages that ping-pong between two local buffers, and stored in order.
+ * A radix-2 stage comes first when log2(FFT_SIZE) is odd,
+ * followed by radix-4 stages. Each work-item computes one radix-4
+ * butterfly, or two radix-2 butterflies, per stage.
+ **********************************************************************/
+static const char *FFT_SOURCE =
+"inline float2 cmul(const float2 a, const float2 b)\n"
+"{\n"
+"    return (float2)(a.x*b.x - a.y*b.y, a.x*b.y + a.y*b.x);\n"
+"}\n"
+"\n"
+"inline float2 twiddle(const float2 a, const float angle)\n"
+"{\n"
+"    float c;\n"
+"    const float s = sincos(angle, &c);\n"
+"    return cmul(a, (float2)(c, s));\n"
+"}\n"
+"\n"
+"__kernel void fft(\n"
+"    __global const float2 *in,\n"
+"    __global float2 *out,\n"
+"    const uint cols,\n"
+"    const uint frames,\n"
+"    __local float2 *scratch\n"
+")\n"
+"{\n"
+"    const uint lid = get_local_id(0);\n"
+"    const uint frame = get_global_id(1);\n"
+"    if (frame >= frames) return; //the whole work-group is one frame\n"
+"    __local float2 *a = scratch;\n"
+"    __local float2 *b = scratch + FFT_SIZE;\n"
+"    __local float2 *t;\n"
+"\n"
+"    in += frame*FFT_SIZE;\n"
+"    out += frame*FFT_SIZE;\n"
+"    for (uint k = lid; k < FFT_SIZE; k += LOCAL_SIZE) a[k] = in[k];\n"
+"    barrier(CLK_LOCAL_MEM_FENCE);\n"
+"\n"
+"    uint Ns = 1;\n"
+"#if RADIX2_STAGE\n"
+"    for (uint j = lid; j < FFT_SIZE/2; j += LOCAL_SIZE)\n"
+"    {\n"
+"        const float2 v0 = a[j];\n"
+"        const float2 v1 = a[j+FFT_SIZE/2];\n"
+"        b[2*j] = v0 + v1;\n"
+"        b[2*j+1] = v0 - v1;\n"
+"    }\n"
+"    barrier(CLK_LOCAL_MEM_FENCE);\n"
+"    t = a; a = b; b = t;\n"
+"    Ns = 2;\n"
+"#endif\n"
+"\n"
+"    for (; Ns < FFT_SIZE; Ns *= 4)\n"
+"    {\n"
+"        const uint j = lid;\n"
+"        const uint k = j%Ns;\n"
+"        const float angle = DIRECTION*2*M_PI_F*k/(Ns*4);\n"
+"        const float2 v0 = a[j];\n"
+"        const float2 v1 = twiddle(a[j+FFT_SIZE/4], angle);\n"
+"        const float2 v2 = twiddle(a[j+FFT_SIZE/2], 2*angle);\n"
+"        const float2 v3 = twiddle(a[j+3*FFT_SIZE/4], 3*angle);\n"
+"        const float2 a0 = v0 + v2;\n"
+"        const float2 a1 = v0 - v2;\n"
+"        const float2 a2 = v1 + v3;\n"
+"        const float2 d = v1 - v3;\n"
+"        const float2 a3 = (float2)(-DIRECTION*d.y, DIRECTION*d.x); //d*(DIRECTION*i)\n"
+"        const uint idx = (j/Ns)*Ns*4 + k;\n"
+"        b[idx] = a0 + a2;\n"
+"        b[idx+Ns] = a1 + a3;\n"
+"        b[idx+2*Ns] = a0 - a2;\n"
+"        b[idx+3*Ns] = a1 - a3;\n"
+"        barrier(CLK_LOCAL_MEM_FENCE);\n"
+"        t = a; a = b; b = t;\n"
+"    }\n"
+"\n"
+"    for (uint k = lid; k < FFT_SIZE; k += LOCAL_SIZE) out[k] = a[k];\n"
+"}\n";
+
+/***********************************************************************
+ * |PothosDoc OpenCL FFT
+ *
+ * Batched forward or inverse FFTs of complex float frames on an OpenCL device.
+ * Each launch transforms all of the whole frames available at the input,
+ * one work-group per frame, with the stages computed in local memory.
+ * The FFT size is a power of two: stages are radix-4,
+ * with a single radix-2 stage when the size is an odd power of two.
+ *
+ * The input stream is a sequence of frames of FFT size elements.
+ * When the producer or consumer is another OpenCL kernel block on the same device,
+ * the frames stay in device memory between the blocks.
+ * The inverse FFT is not normalized: a forward and inverse transform scales by the FFT size.
+ *
+ * |category /OpenCL
+ * |category /FFT
+ * |keywords opencl fft dft spectrum fourier
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |param fftSize[FFT Size] The number of elements in each FFT frame.
+ * The size is limited by the local memory and the work-group size of the device:
+ * two frames of complex floats must fit in local memory,
+ * and each work-group has one work-item per four elements.
+ * |default 1024
+ * |option 64
+ * |option 256
+ * |option 1024
+ * |option 4096
+ * |widget ComboBox(editable=true)
+ *
+ * |param inverse[Inverse] Compute the inverse FFT instead of the forward FFT.
+ * |default false
+ * |option [Forward] false
+ * |option [Inverse] true
+ *
+ * |factory /blocks/opencl_fft(deviceId, fftSize)
+ * |setter setInverse(inverse)
+ **********************************************************************/
+class OpenClFft : public OpenClKernel
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId, const size_t fftSize)
+    {
+        return new OpenClFft(deviceId, fftSize);
+    }
+
+    OpenClFft(const std::string &deviceId, const size_t fftSize):
+        OpenClKernel(deviceId, std::vector<std::string>(1, "complex_float32"), std::vector<std::string>(1, "complex_float32")),
+        _fftSize(0),
+        _inverse(false)
+    {
+        this->setFftSize(fftSize);
+        this->setSource("fft", FFT_SOURCE);
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFft, setFftSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFft, getFftSize));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFft, setInverse));
+        this->registerCall(this, POTHOS_FCN_TUPLE(OpenClFft, getInverse));
+    }
+
+    void setFftSize(const size_t fftSize)
+    {
+        if (fftSize < 2 or (fftSize & (fftSize-1)) != 0)
+        {
+            throw Pothos::Exception("OpenClFft::setFftSize("+std::to_string(fftSize)+")", "size must be a power of two");
+        }
+
+        size_t maxWorkGroupSize = 0;
+        cl_ulong localMemSize = 0;
+        cl_int err = clGetDeviceInfo(this->getDevice(), CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, nullptr);
+        if (err == 0) err = clGetDeviceInfo(this->getDevice(), CL_DEVICE_LOCAL_MEM_SIZE, sizeof(localMemSize), &localMemSize, nullptr);
+        if (err < 0) throw Pothos::Exception("OpenClFft::clGetDeviceInfo()", clErrToStr(err));
+        if (this->localSize(fftSize) > maxWorkGroupSize or this->localBytes(fftSize) > localMemSize)
+        {
+            throw Pothos::Exception("OpenClFft::setFftSize("+std::to_string(fftSize)+")", "size exceeds the device limits");
+        }
+
+        _fftSize = fftSize;
+        this->updateFft();
+    }
+
+    size_t getFftSize(void) const
+    {
+        return _fftSize;
+    }
+
+    void setInverse(const bool inverse)
+    {
+        _inverse = inverse;
+        this->updateFft();
+    }
+
+    bool getInverse(void) const
+    {
+        return _inverse;
+    }
+
+private:
+    static size_t localSize(const size_t fftSize)
+    {
+        return std::max<size_t>(fftSize/4, 1);
+    }
+
+    static size_t localBytes(const size_t fftSize)
+    {
+        return 2*fftSize*sizeof(std::complex<float>);
+    }
+
+    void updateFft(void)
+    {
+        size_t log2Size = 0;
+        while ((size_t(1) << log2Size) < _fftSize) log2Size++;
+
+        Pothos::ObjectKwargs defines;
+        defines["FFT_SIZE"] = Pothos::Object(std::to_string(_fftSize));
+        defines["LOCAL_SIZE"] = Pothos::Object(std::to_string(localSize(_fftSize)));
+        defines["RADIX2_STAGE"] = Pothos::Object(std::to_string(log2Size%2));
+        defines["DIRECTION"] = Pothos::Object(std::string(_inverse?"1":"-1"));
+
+        //a two dimensional range of [local size, frames], one work-group per frame,
+        //the shapes and local memory only match a kernel built with the new defines
+        const size_t fftSize = _fftSize;
+        this->setDefinesWithLaunchState(defines, [this, fftSize](void)
+        {
+            this->setFrameShape(std::vector<size_t>(1, localSize(fftSize)));
+            this->setLocalShape(std::vector<size_t>{localSize(fftSize), 1});
+            this->setGlobalFactor(double(localSize(fftSize))/fftSize);
+            this->setLocalArg(4, localBytes(fftSize));
+        });
+    }
+
+    size_t _fftSize;
+    bool _inverse;
+};
+
+static Pothos::BlockRegistry registerOpenClFft(
+    "/blocks/opencl_fft", &OpenClFft::make);
@@ -4,18 +4,67 @@
 #include "OpenClKernel.hpp"
 #include <Pothos/Framework.hpp>
 #include <Poco/NumberParser.h>
+#include <Poco/MD5Engine.h>
+#include <Poco/StringTokenizer.h>
+#include <chrono>
 #include <vector>
+#include <deque>
+#include <map>
 #include <iostream>
 #include <fstream>
-#include <algorithm> //min/max
+#include <cstring> //memcpy
+#include <algorithm> //min/max/remove_if
+
+/***********************************************************************
+ * Lookup a device from the [platform index]:[device index] markup
+ **********************************************************************/
+static cl_device_id lookupDevice(const std::string &deviceId)
+{
+    const auto colon = deviceId.find(":");
+    const auto platformIndex = Poco::NumberParser::parseUnsigned(deviceId.substr(0, colon));
+    const auto deviceIndex = Poco::NumberParser::parseUnsigned(deviceId.substr(colon+1));
+
+    /* Identify a platform */
+    cl_int err = 0;
+    cl_uint num_platforms = 0;
+    cl_platform_id platforms[64];
+    err = clGetPlatformIDs(64, platforms, &num_platforms);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clGetPlatformIDs()", clErrToStr(err));
+    if (platformIndex >= num_platforms) throw Pothos::Exception("OpenClKernel("+deviceId+")", "platform index does not exist");
+
+    /* Access a device */
+    cl_uint num_devices = 0;
+    cl_device_id devices[64];
+    err = clGetDeviceIDs(platforms[platformIndex], CL_DEVICE_TYPE_ALL, 64, devices, &num_devices);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clGetDeviceIDs()", clErrToStr(err));
+    if (deviceIndex >= num_devices) throw Pothos::Exception("OpenClKernel("+deviceId+")", "device index does not exist");
+    return devices[deviceIndex];
+}
 
 /***********************************************************************
  * |PothosDoc OpenCL Kernel
  *
  * The OpenCL Kernel block executes a kernel on supported devices.
  * The kernel source is just in time (JIT) compiled by the OpenCL API.
- * This block exclusively computes kernels of one dimensional arrays.
- * Two and three dimensional kernels and others others are not handled by this block
+ * By default, the kernel is launched over a one dimensional range.
+ * Set the frame shape to launch two and three dimensional ranges,
+ * where the outer dimension is the number of frames in the available elements.
+ *
+ * When every consumer of an output port is another OpenCL kernel block
+ * on the same device, the output stays in device memory and is handed
+ * to the downstream kernel without being read back to the host.
+ *
+ * Kernel arguments are bound in this order: the input buffers, the output buffers,
+ * the extents of multi-dimensional ranges, and the input offsets in circular buffer mode.
+ * Additional arguments are bound by their index in the kernel signature
+ * following those automatic arguments:
+ * <ul>
+ * <li>setScalarArg(index, dtype, value) - a scalar such as a gain or element count</li>
+ * <li>setConstantArg(index, dtype, values) - a read-only buffer such as filter taps,
+ * uploaded once and kept device resident until it is set again</li>
+ * <li>setLocalArg(index, numBytes) - a __local scratch allocation</li>
+ * </ul>
+ * Each of these calls can also be connected as a slot to update the argument at runtime.
  *
  * |category /Kernels
  * |category /OpenCL
@@ -25,6 +74,15 @@
  * The markup takes the format [platform index]:[device index]
  * The platform index represents a platform ID found in clGetPlatformIDs().
  * The device index represents a device ID found in clGetDeviceIDs().
+ * A comma separated list of devices splits each launch across the devices,
+ * in proportion to the measured throughput of each device, example: "0:0, 1:0".
+ * The first device is the primary: it owns the port buffers and runs its share
+ * like a single device block. The other devices receive their share of the inputs
+ * through host memory and their outputs are written back into the primary's buffers.
+ * The throughput of each device is the profiled time of the commands it runs for its share,
+ * so the transfers of the other devices count against them.
+ * Launches are only split for one dimensional ranges with global and production
+ * factors of 1.0 and no input history, other launches run on the primary device.
  * |default "0:0"
  *
  * |param inputTypes[Input Types] An array of input port sizes.
@@ -42,292 +100,1964 @@
  * |param kernelSource[Kernel Source] Source code for an OpenCL kernel.
  * The source can either be a string representing the cl source,
  * or a path to a .cl file containing the cl source code.
+ * Compiled program binaries are cached on disk per device and driver version,
+ * so that later topologies with the same source skip the JIT compilation.
+ * Set the POTHOS_OPENCL_CACHE_MAX_BYTES environment variable to bound the cache size,
+ * or to 0 to disable the cache. Call /devices/opencl/clear_cache to clear it.
+ * Programs are built on a background thread, so blocks build in parallel.
+ * When the source, options, or defines change at runtime, the block keeps
+ * launching the previous kernel until the new build completes,
+ * and the new kernel is swapped in between calls to work().
+ * A failed build is reported by the next call to work(),
+ * and the previous kernel remains in use.
+ * Arguments, history, and shapes take effect on the next launch,
+ * so set them to values that are valid for both kernels.
  * |default ""
  * |widget FileEntry(mode=open)
  *
+ * |param buildOptions[Build Options] Options passed to the OpenCL compiler.
+ * Example: "-cl-fast-relaxed-math -cl-mad-enable"
+ * |default ""
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |param defines[Defines] A map of named compile-time constants.
+ * Each entry is passed to the compiler as -D NAME=VALUE,
+ * so one kernel source can be specialized for tap counts, vector widths, and types.
+ * Each specialization is built and cached separately.
+ * |default {}
+ * |preview valid
+ *
  * |param localSize[Local Size] The number of work units/resources to allocate.
  * This controls the parallelism of the kernel execution.
+ * A local size of 0 automatically tunes the local size of the first dimension:
+ * multiples of the kernel's preferred work-group size multiple are timed
+ * on the live stream, and the fastest is remembered per device, kernel, and global size.
+ * Together with the local shape of the other dimensions, the candidates
+ * stay within the maximum work-group size of the kernel.
+ * For one dimensional ranges, the global size is rounded down to a multiple of the tuned size.
  * |default 2
+ * |option [Auto] 0
+ * |widget ComboBox(editable=true)
+ *
+ * |param localShape[Local Shape] The work-group size for each dimension.
+ * This overrides the local size for two and three dimensional ranges.
+ * Missing dimensions default to 1, and an empty shape uses the local size.
+ * |default []
+ * |preview valid
+ *
+ * |param frameShape[Frame Shape] The inner dimensions of a multi-dimensional range.
+ * An empty shape launches a one dimensional range over the global size.
+ * A shape of [cols] launches a two dimensional range of [cols, frames],
+ * and a shape of [cols, rows] launches a three dimensional range of [cols, rows, frames],
+ * where frames is the number of whole frames in the global size.
+ * Each global dimension is padded up to a multiple of its local size,
+ * and the real extent of each dimension is passed to the kernel as a uint argument
+ * following the output buffers, so that padded work-items can return early.
+ * |default []
+ * |preview valid
+ *
+ * |param scalarArgs[Scalar Arguments] A map of additional scalar kernel arguments.
+ * Each key is the index of the argument in the kernel signature,
+ * and each value is a pair of [data type, value]. Example: {"2": ["float32", 0.5]}
+ * Scalars can be updated at runtime with the setScalarArg() slot.
+ * |default {}
+ * |preview valid
+ *
+ * |param localArgs[Local Arguments] A map of additional __local kernel arguments.
+ * Each key is the index of the argument in the kernel signature,
+ * and each value is the size of the local memory allocation in bytes.
+ * |default {}
+ * |preview valid
+ *
+ * |param histories[Input History] The number of history elements for each input port.
+ * With a history of H elements, the input buffer presented to the kernel
+ * starts with the last H elements of the previous launch, followed by the new elements.
+ * The history stays in device memory between launches, and is zero at the start of a stream.
+ * The global size only covers the new elements, so that work-item i can read
+ * input elements i through i+H, as required by FIR filters and correlators.
+ * Missing entries default to no history. Example: [15] for a 16 tap filter.
+ * |default []
+ * |preview valid
+ *
+ * |param inputComputeTypes[Input Compute Types] A map of inputs converted on the device.
+ * Each key is the index of an input port, and each value is a pair of [compute type, scale].
+ * The port carries its narrow input type, such as int8, int16, or complex_int16,
+ * and each launch converts the elements to the compute type, multiplied by the scale,
+ * before the kernel reads them. This reduces the bytes copied to the device.
+ * Launches with converted ports are not split across multiple devices.
+ * Example: {"0": ["complex_float32", 3.0517578125e-05]} for full scale complex_int16.
+ * |default {}
+ * |preview valid
+ *
+ * |param outputComputeTypes[Output Compute Types] A map of outputs converted on the device.
+ * Each key is the index of an output port, and each value is a pair of [compute type, scale].
+ * The kernel writes the compute type, and each element is multiplied by the scale,
+ * then rounded and saturated to the narrow output type before it is read back.
+ * Example: {"0": ["complex_float32", 32767.0]} for a complex_int16 output.
+ * |default {}
+ * |preview valid
  *
  * |param globalFactor[Global Factor] This factor controls the global size.
  * The global size is the number of kernel iterarions per call.
  * Global size = number of input elements * global factor.
+ * A factor below 1.0 means that each work-item processes several elements,
+ * such as a vectorized kernel, and only whole groups of elements are consumed.
  * |default 1.0
  *
  * |param productionFactor[Production Factor] This factor controls the elements produced.
  * For each call to work, elements produced = number of input elements * production factor.
  * |default 1.0
  *
+ * |param bufferSize[Buffer Size] The size of each OpenCL port buffer in bytes.
+ * This bounds the number of elements processed by a single kernel launch.
+ * The buffer size must be set before the topology is committed.
+ * Use 0 for the framework's default buffer size.
+ * |unit bytes
+ * |default 0
+ * |preview valid
+ *
+ * |param bufferMode[Buffer Mode] How input buffers from host blocks are allocated.
+ * <ul>
+ * <li>DISCRETE - each buffer is a separate slab of device memory,
+ * which is copied to and from host memory around the kernel.
+ * On devices with unified host memory (CL_DEVICE_HOST_UNIFIED_MEMORY),
+ * each buffer wraps host memory instead, and is unmapped before the kernel
+ * and mapped after it without copying.</li>
+ * <li>CIRCULAR - a ring buffer that is addressed modulo its size on the device,
+ * so large contiguous windows are always available and a kernel can read across
+ * the boundary of two upstream buffers. This allows fewer, larger launches,
+ * and the remainder of a partially consumed input is launched with the next buffer.
+ * Each element is uploaded once, a window that wraps around the end of the ring
+ * costs a device side copy of the wrapped part.
+ * Because an input window can start anywhere in the ring, the kernel takes
+ * a uint element offset for each input following the automatic arguments above,
+ * and must index input i as in_i[offset_i + get_global_id(0)].</li>
+ * <li>SVM - shared virtual memory buffers for inputs from and outputs to host blocks,
+ * on devices that support OpenCL 2.0 SVM. The host and the device access the same memory,
+ * so uploads and readbacks do not copy. Fine-grained buffers are used when supported,
+ * otherwise coarse-grained buffers are mapped and unmapped around host access.
+ * Devices without SVM support use discrete buffers. SVM inputs cannot have history,
+ * and launches with SVM buffers are not split across multiple devices.</li>
+ * </ul>
+ * The buffer mode must be set before the topology is committed.
+ * |default "DISCRETE"
+ * |option [Discrete] "DISCRETE"
+ * |option [Circular] "CIRCULAR"
+ * |option [Shared Virtual Memory] "SVM"
+ * |preview valid
+ *
+ * |param profiling[Profiling] Enable profiling of kernel and transfer events.
+ * When enabled, the block records the event timestamps of the command queue, and getProfilingStats()
+ * returns rolling statistics (min, mean, p99, max) of kernel execution, upload, and
+ * download times, transfer bytes and rates, queue wait time, and launches per second.
+ * This helps decide if a block is compute or transfer bound.
+ * Profiling can be enabled while the topology runs, and starts with empty statistics.
+ * |default false
+ * |option [Disabled] false
+ * |option [Enabled] true
+ * |preview valid
+ *
+ * |param minBatch[Minimum Batch] The minimum number of input elements per launch.
+ * When less input is available, the block waits for more input,
+ * up to the batch timeout, to avoid launch overhead dominating bursty streams.
+ * The minimum batch should fit in the input buffers, or each launch waits for the timeout.
+ * Use 0 to launch on any available input.
+ * |unit elements
+ * |default 0
+ * |preview valid
+ *
+ * |param maxBatch[Maximum Batch] The maximum number of input elements per launch.
+ * This bounds the latency of each launch on live streams. Use 0 for no limit.
+ * |unit elements
+ * |default 0
+ * |preview valid
+ *
+ * |param batchTimeout[Batch Timeout] The time to wait for the minimum batch.
+ * A partial batch is launched once this time has passed since the block started waiting.
+ * The block does not sleep while waiting, the time is checked when new input arrives
+ * or when the scheduler calls the block again after its timeout.
+ * |unit seconds
+ * |default 0.01
+ * |preview valid
+ *
+ * |param packetMode[Packet Mode] Process packet messages instead of streams.
+ * The block has one input port, and the packets available at the input are batched
+ * into a single device buffer, up to the maximum batch of elements, for one kernel launch.
+ * The kernel signature is (in, outputs..., __global const uint *offsets,
+ * __global const uint *lengths, const uint numPackets), followed by additional arguments,
+ * where offsets and lengths locate each packet in the input buffer in elements.
+ * The global size is the total number of elements times the global factor,
+ * padded up to a multiple of the local size, so work-items past the end must return early.
+ * Packet p produces length*production factor elements at offset*production factor
+ * of each output buffer, and each output port emits one packet per input packet,
+ * with the metadata and labels of the input packet. Other messages are forwarded.
+ * The frame shape, history, compute types, and variable output only apply to streams.
+ * |default false
+ * |option [Streams] false
+ * |option [Packets] true
+ * |preview valid
+ *
+ * |param variableOutput[Variable Output] Let the kernel decide how many elements it produces.
+ * The kernel takes a __global uint *counts argument following the automatic arguments above,
+ * with one counter per output port that is zero at the start of each launch.
+ * The kernel increments counts[k] with atomic_inc() for each element it writes to output k,
+ * and uses the previous count as the index of the element, as in stream compaction.
+ * The capacity of each output is the number of input elements times the production factor.
+ * Only the produced elements are read back from the device, once the counts are read back.
+ * Labels are clamped to the elements produced by their launch.
+ * Launches with variable outputs are not split across multiple devices.
+ * |default false
+ * |option [Fixed] false
+ * |option [Variable] true
+ * |preview valid
+ *
+ * |param pipelineDepth[Pipeline Depth] The maximum number of kernel launches in flight.
+ * Each launch chains the input upload, kernel execution, and output readback
+ * on the command queue without blocking the calling thread.
+ * Output buffers are only produced once their readback completes.
+ * A depth of 1 waits for every launch to complete before returning from work().
+ * Larger depths overlap the next upload with the current computation,
+ * and the block waits on the oldest launch once the depth is reached.
+ * |default 1
+ * |preview valid
+ *
+ * |param queueMode[Queue Mode] The command queue used by this block.
+ * <ul>
+ * <li>PRIVATE - an in-order queue used only by this block</li>
+ * <li>SHARED - an in-order queue shared by all blocks on this device,
+ * so back to back kernels are ordered on the device without host synchronization</li>
+ * <li>OUT_OF_ORDER - a shared out-of-order queue; each buffer carries the event
+ * of the command that wrote it, so independent branches of a topology run concurrently</li>
+ * </ul>
+ * The queue mode should be set before the topology is committed.
+ * |default "PRIVATE"
+ * |option [Private] "PRIVATE"
+ * |option [Shared] "SHARED"
+ * |option [Out of Order] "OUT_OF_ORDER"
+ * |preview valid
+ *
  * |factory /blocks/opencl_kernel(deviceId, inputTypes, outputTypes)
  * |setter setSource(kernelName, kernelSource)
+ * |setter setBuildOptions(buildOptions)
+ * |setter setDefines(defines)
  * |setter setLocalSize(localSize)
+ * |setter setLocalShape(localShape)
+ * |setter setFrameShape(frameShape)
  * |setter setGlobalFactor(globalFactor)
  * |setter setProductionFactor(productionFactor)
+ * |setter setScalarArgs(scalarArgs)
+ * |setter setLocalArgs(localArgs)
+ * |setter setHistories(histories)
+ * |setter setInputComputeTypes(inputComputeTypes)
+ * |setter setOutputComputeTypes(outputComputeTypes)
+ * |setter setMinBatch(minBatch)
+ * |setter setMaxBatch(maxBatch)
+ * |setter setBatchTimeout(batchTimeout)
+ * |setter setPacketMode(packetMode)
+ * |setter setVariableOutput(variableOutput)
+ * |setter setPipelineDepth(pipelineDepth)
+ * |setter setBufferSize(bufferSize)
+ * |setter setBufferMode(bufferMode)
+ * |setter setProfilingEnabled(profiling)
+ * |setter setQueueMode(queueMode)
  **********************************************************************/
-class OpenClKernel : public Pothos::Block
+OpenClKernel::OpenClKernel(const std::string &deviceId, const std::vector<std::string> &inputTypes, const std::vector<std::string> &outputTypes):
+    _queueMode("PRIVATE"),
+    _bufferMode("DISCRETE"),
+    _localShape(1, 1),
+    _globalFactor(1.0),
+    _partialWorkItems(false),
+    _productionFactor(1.0),
+    _pipelineDepth(1),
+    _bufferSize(0),
+    _minBatch(0),
+    _maxBatch(0),
+    _batchTimeout(0.01),
+    _batchWaiting(false),
+    _variableOutput(false),
+    _packetMode(false)
 {
-public:
-    static Pothos::Block *make(const std::string &deviceId, const std::vector<std::string> &inputTypes, const std::vector<std::string> &outputTypes)
-    {
-        return new OpenClKernel(deviceId, inputTypes, outputTypes);
-    }
+    //the first device in the list is the primary device
+    const Poco::StringTokenizer deviceIds(deviceId, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+    if (deviceIds.count() == 0) throw Pothos::Exception("OpenClKernel()", "no device specified");
+    _device = lookupDevice(deviceIds[0]);
+    const cl_int err = clGetDeviceInfo(_device, CL_DEVICE_PLATFORM, sizeof(_platform), &_platform, nullptr);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clGetDeviceInfo()", clErrToStr(err));
 
-    OpenClKernel(const std::string &deviceId, const std::vector<std::string> &inputTypes, const std::vector<std::string> &outputTypes);
+    /* Create context */
+    _context = lookupContextCache(_device);
 
-    ~OpenClKernel(void)
+    //shared with the buffer managers, recording is off until profiling is enabled
+    _profiler.reset(new OpenClProfiler());
+
+    /* Additional devices have their own in-order queue, a device may be listed again */
+    for (size_t i = 1; i < deviceIds.count(); i++)
     {
-        //reset in order of creation
-        _kernel.reset();
-        _queue.reset();
-        _program.reset();
-        _context.reset();
+        SecondaryDevice secondary;
+        secondary.device = lookupDevice(deviceIds[i]);
+        secondary.context = lookupContextCache(secondary.device);
+        secondary.queue = makeCommandQueue(secondary.context, secondary.device, CL_QUEUE_PROFILING_ENABLE);
+        secondary.inputs.resize(inputTypes.size());
+        secondary.outputs.resize(outputTypes.size());
+        _secondaries.push_back(secondary);
     }
+    _deviceRates.assign(1+_secondaries.size(), 0.0);
 
-    void setSource(const std::string &name, const std::string &source);
-
-    void setLocalSize(const size_t size)
+    /* Create ports */
+    _myDomain = "OpenCl_"+std::to_string(size_t(_device));
+    for (size_t i = 0; i < inputTypes.size(); i++)
+    {
+        this->setupInput(i, Pothos::DType(inputTypes[i]), _myDomain);
+    }
+    for (size_t i = 0; i < outputTypes.size(); i++)
     {
-        _localSize = size;
+        this->setupOutput(i, Pothos::DType(outputTypes[i]), _myDomain);
     }
+    _deviceResident.resize(outputTypes.size(), false);
+    _histories.resize(inputTypes.size());
+    for (auto &history : _histories) history.numElems = 0;
+    _inputConversions.resize(inputTypes.size());
+    for (auto &conversion : _inputConversions) conversion.computeSize = 0;
+    _outputConversions.resize(outputTypes.size());
+    for (auto &conversion : _outputConversions) conversion.computeSize = 0;
+
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setSource));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setKernelChain));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getKernelChain));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setIntermediateTypes));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setBuildOptions));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getBuildOptions));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setDefines));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setScalarArg));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setConstantArg));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setLocalArg));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setScalarArgs));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setLocalArgs));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setHistory));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getHistory));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setHistories));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setInputComputeType));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setOutputComputeType));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setInputComputeTypes));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setOutputComputeTypes));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setLocalSize));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getLocalSize));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setLocalShape));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getLocalShape));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setFrameShape));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getFrameShape));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setGlobalFactor));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getGlobalFactor));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setProductionFactor));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getProductionFactor));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setMinBatch));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getMinBatch));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setMaxBatch));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getMaxBatch));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setBatchTimeout));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getBatchTimeout));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setPacketMode));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getPacketMode));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setVariableOutput));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getVariableOutput));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setPipelineDepth));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getPipelineDepth));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setBufferSize));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getBufferSize));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setBufferMode));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getBufferMode));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setQueueMode));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getQueueMode));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setProfilingEnabled));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getProfilingEnabled));
+    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getProfilingStats));
+    this->registerProbe("getProfilingStats");
+}
 
-    size_t getLocalSize(void) const
+/***********************************************************************
+ * Load kernel source from file if it ends in .cl
+ **********************************************************************/
+static std::string loadKernelSource(const std::string &kernelSource_)
+{
+    auto kernelSource = kernelSource_;
+    if (kernelSource.size() > 3 and kernelSource.substr(kernelSource.size()-3) == ".cl")
     {
-        return _localSize;
+        std::cout << "OpenClKernel block loading " << kernelSource << "..." << std::endl;
+        std::ifstream t(kernelSource);
+        if (not t.good()) throw Pothos::Exception("OpenClKernel::setSource("+kernelSource+")", "cant read file");
+        kernelSource = std::string((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
     }
 
-    void setGlobalFactor(const double factor)
+    if (kernelSource.empty()) throw Pothos::Exception("OpenClKernel::setSource()", "no source specified");
+    return kernelSource;
+}
+
+void OpenClKernel::setSource(const std::string &kernelName, const std::string &kernelSource)
+{
+    _kernelSource = loadKernelSource(kernelSource);
+    _kernelName = kernelName;
+    _chainNames.clear();
+    this->updateKernel();
+}
+
+void OpenClKernel::setKernelChain(const std::vector<std::string> &names, const std::string &source)
+{
+    if (names.empty()) throw Pothos::Exception("OpenClKernel::setKernelChain()", "no kernel names specified");
+    _kernelSource = loadKernelSource(source);
+    _kernelName = names.front();
+    _chainNames.assign(names.begin()+1, names.end());
+    this->updateKernel();
+}
+
+void OpenClKernel::setIntermediateTypes(const std::vector<std::string> &types)
+{
+    _intermediateTypeNames = types;
+    this->updateChainTypes();
+}
+
+void OpenClKernel::updateChainTypes(void)
+{
+    //intermediate results default to the type of the first output
+    _chainTypes.clear();
+    for (size_t i = 0; i < _chainKernels.size(); i++)
     {
-        _globalFactor = factor;
+        if (i < _intermediateTypeNames.size()) _chainTypes.emplace_back(_intermediateTypeNames[i]);
+        else if (not this->outputs().empty()) _chainTypes.push_back(this->output(0)->dtype());
+        else _chainTypes.push_back(this->input(0)->dtype());
     }
 
-    double getGlobalFactor(void) const
+    //start over with new staging pools, buffers in use by a launch are released with it
+    _chainBuffers.clear();
+    _chainBuffers.resize(_chainKernels.size());
+}
+
+void OpenClKernel::setBuildOptions(const std::string &options)
+{
+    _buildOptions = options;
+    if (not _kernelSource.empty()) this->updateKernel();
+}
+
+void OpenClKernel::setDefines(const Pothos::ObjectKwargs &defines)
+{
+    _defines.clear();
+    for (const auto &pair : defines)
     {
-        return _globalFactor;
+        const auto &value = pair.second;
+        if (value.type() == typeid(std::string)) _defines[pair.first] = value.extract<std::string>();
+        else _defines[pair.first] = value.toString();
     }
+    if (not _kernelSource.empty()) this->updateKernel();
+}
+
+void OpenClKernel::setDefinesWithLaunchState(const Pothos::ObjectKwargs &defines, const std::function<void(void)> &launchState)
+{
+    //the launch state is carried by every build until one is swapped in
+    _launchState = launchState;
+    this->setDefines(defines);
 
-    void setProductionFactor(const double factor)
+    //without a source there is no kernel to pair with, so apply it now
+    if (_kernelSource.empty())
     {
-        _productionFactor = factor;
+        _launchState = nullptr;
+        launchState();
     }
+}
+
+/***********************************************************************
+ * Pack a value into the binary representation of a scalar type
+ **********************************************************************/
+template <typename T>
+static void packValue(std::vector<char> &bytes, const double value)
+{
+    const T v = T(value);
+    const char *p = reinterpret_cast<const char *>(&v);
+    bytes.insert(bytes.end(), p, p+sizeof(v));
+}
+
+static void packScalar(std::vector<char> &bytes, const std::string &dtype, const double value)
+{
+    const auto name = Pothos::DType(dtype).name();
+    if (name == "int8") packValue<cl_char>(bytes, value);
+    else if (name == "int16") packValue<cl_short>(bytes, value);
+    else if (name == "int32") packValue<cl_int>(bytes, value);
+    else if (name == "int64") packValue<cl_long>(bytes, value);
+    else if (name == "uint8") packValue<cl_uchar>(bytes, value);
+    else if (name == "uint16") packValue<cl_ushort>(bytes, value);
+    else if (name == "uint32") packValue<cl_uint>(bytes, value);
+    else if (name == "uint64") packValue<cl_ulong>(bytes, value);
+    else if (name == "float32") packValue<cl_float>(bytes, value);
+    else if (name == "float64") packValue<cl_double>(bytes, value);
+    else throw Pothos::Exception("OpenClKernel::packScalar("+dtype+")", "unsupported scalar type");
+}
+
+void OpenClKernel::setScalarArg(const size_t index, const std::string &dtype, const double value)
+{
+    KernelArg arg;
+    packScalar(arg.value, dtype, value);
+    arg.localSize = 0;
+    _kernelArgs[index] = arg;
+}
 
-    double getProductionFactor(void) const
+void OpenClKernel::setConstantArg(const size_t index, const std::string &dtype, const std::vector<double> &values)
+{
+    KernelArg arg;
+    for (const auto value : values) packScalar(arg.value, dtype, value);
+    if (arg.value.empty()) throw Pothos::Exception("OpenClKernel::setConstantArg()", "no values specified");
+    arg.localSize = 0;
+
+    //upload once to each device: the buffer stays device resident until replaced
+    std::vector<std::shared_ptr<cl_context>> contexts(1, _context);
+    for (const auto &secondary : _secondaries) contexts.push_back(secondary.context);
+    for (const auto &context : contexts)
     {
-        return _productionFactor;
+        cl_int err = 0;
+        auto memobj = clCreateBuffer(*context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, arg.value.size(), arg.value.data(), &err);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::setConstantArg::clCreateBuffer()", clErrToStr(err));
+        arg.memobjs.emplace_back(new cl_mem(memobj), clReleaseMemObjectPtr);
     }
+    _kernelArgs[index] = arg;
+}
+
+void OpenClKernel::setLocalArg(const size_t index, const size_t numBytes)
+{
+    if (numBytes == 0) throw Pothos::Exception("OpenClKernel::setLocalArg()", "local size must be non-zero");
+    KernelArg arg;
+    arg.localSize = numBytes;
+    _kernelArgs[index] = arg;
+}
 
-    Pothos::BufferManager::Sptr getInputBufferManager(const std::string &, const std::string &domain)
+void OpenClKernel::setScalarArgs(const Pothos::ObjectKwargs &args)
+{
+    for (const auto &pair : args)
     {
-        if (domain.empty())
-        {
-            OpenClBufferContainerArgs args;
-            args.mem_flags = CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR;
-            args.map_flags = CL_MAP_WRITE;
-            args.context = _context;
-            args.queue = _queue;
-            return makeOpenClBufferManager(args);
-        }
-        if (domain == _myDomain)
-        {
-            return Pothos::BufferManager::Sptr();
-        }
-        throw Pothos::PortDomainError();
+        const auto pairArgs = pair.second.convert<Pothos::ObjectVector>();
+        if (pairArgs.size() != 2) throw Pothos::Exception("OpenClKernel::setScalarArgs()", "expected [dtype, value] for "+pair.first);
+        this->setScalarArg(Poco::NumberParser::parseUnsigned(pair.first), pairArgs[0].convert<std::string>(), pairArgs[1].convert<double>());
     }
+}
 
-    Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &, const std::string &domain)
+void OpenClKernel::setLocalArgs(const Pothos::ObjectKwargs &args)
+{
+    for (const auto &pair : args)
     {
-        if (domain.empty() or domain == _myDomain)
-        {
-            OpenClBufferContainerArgs args;
-            args.mem_flags = CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR;
-            args.map_flags = 0;
-            args.context = _context;
-            args.queue = _queue;
-            return makeOpenClBufferManager(args);
-        }
-        throw Pothos::PortDomainError();
+        this->setLocalArg(Poco::NumberParser::parseUnsigned(pair.first), pair.second.convert<size_t>());
     }
+}
 
-    void work(void);
+void OpenClKernel::setHistory(const size_t index, const size_t numElems)
+{
+    if (index >= _histories.size()) throw Pothos::RangeException("OpenClKernel::setHistory()", "no input "+std::to_string(index));
+    auto &history = _histories[index];
+    history.numElems = numElems;
+
+    //start over with zeros, staging buffers in use by a launch are released with it
+    history.buffers.clear();
+    history.tail.reset();
+    history.tailEvent.reset();
+}
 
-    void propagateLabels(const Pothos::InputPort *port)
+void OpenClKernel::setHistories(const std::vector<size_t> &histories)
+{
+    if (histories.size() > _histories.size()) throw Pothos::RangeException("OpenClKernel::setHistories()", "more entries than inputs");
+    for (size_t i = 0; i < _histories.size(); i++)
     {
-        for (auto outputPort : this->outputs())
-        {
-            for (const auto &label : port->labels())
-            {
-                outputPort->postLabel(label.toAdjusted(_productionFactor, 1.0));
-            }
-        }
+        this->setHistory(i, (i < histories.size())?histories[i]:0);
     }
+}
 
-private:
-    std::string _myDomain;
-    cl_platform_id _platform;
-    cl_device_id _device;
-    std::shared_ptr<cl_context> _context;
-    std::shared_ptr<cl_program> _program;
-    std::shared_ptr<cl_kernel> _kernel;
-    std::shared_ptr<cl_command_queue> _queue;
-    size_t _localSize;
-    double _globalFactor;
-    double _productionFactor;
-};
+void OpenClKernel::setInputComputeType(const size_t index, const std::string &dtype, const double scale)
+{
+    if (index >= _inputConversions.size()) throw Pothos::RangeException("OpenClKernel::setInputComputeType()", "no input "+std::to_string(index));
 
-OpenClKernel::OpenClKernel(const std::string &deviceId, const std::vector<std::string> &inputTypes, const std::vector<std::string> &outputTypes):
-    _localSize(1),
-    _globalFactor(1.0),
-    _productionFactor(1.0)
+    //start over with a new staging pool, buffers in use by a launch are released with it
+    auto &conversion = _inputConversions[index];
+    conversion = PortConversion();
+    conversion.computeSize = 0;
+    if (dtype.empty()) return;
+
+    //the port carries the wire type, the kernel reads the compute type
+    const Pothos::DType computeType(dtype);
+    conversion.kernel = makeOpenClPortConvertKernel(_context, _device, this->input(index)->dtype(), computeType);
+    conversion.computeSize = computeType.size();
+    conversion.scale = scale;
+}
+
+void OpenClKernel::setOutputComputeType(const size_t index, const std::string &dtype, const double scale)
 {
-    const auto colon = deviceId.find(":");
-    const auto platformIndex = Poco::NumberParser::parseUnsigned(deviceId.substr(0, colon));
-    const auto deviceIndex = Poco::NumberParser::parseUnsigned(deviceId.substr(colon+1));
+    if (index >= _outputConversions.size()) throw Pothos::RangeException("OpenClKernel::setOutputComputeType()", "no output "+std::to_string(index));
 
-    /* Identify a platform */
-    cl_int err = 0;
-    cl_uint num_platforms = 0;
-    cl_platform_id platforms[64];
-    err = clGetPlatformIDs(64, platforms, &num_platforms);
-    if (err < 0) throw Pothos::Exception("OpenClKernel::clGetPlatformIDs()", clErrToStr(err));
-    if (platformIndex >= num_platforms) throw Pothos::Exception("OpenClKernel()", "platform index does not exist");
-    _platform = platforms[platformIndex];
+    //start over with a new staging pool, buffers in use by a launch are released with it
+    auto &conversion = _outputConversions[index];
+    conversion = PortConversion();
+    conversion.computeSize = 0;
+    if (dtype.empty()) return;
 
-    /* Access a device */
-    cl_uint num_devices = 0;
-    cl_device_id devices[64];
-    err = clGetDeviceIDs(_platform, CL_DEVICE_TYPE_ALL, 64, devices, &num_devices);
-    if (err < 0) throw Pothos::Exception("OpenClKernel::clGetDeviceIDs()", clErrToStr(err));
-    if (deviceIndex >= num_devices) throw Pothos::Exception("OpenClKernel()", "device index does not exist");
-    _device = devices[deviceIndex];
+    //the kernel writes the compute type, the port carries the wire type
+    const Pothos::DType computeType(dtype);
+    conversion.kernel = makeOpenClPortConvertKernel(_context, _device, computeType, this->output(index)->dtype());
+    conversion.computeSize = computeType.size();
+    conversion.scale = scale;
+}
 
-    /* Create context */
-    _context = lookupContextCache(_device);
+void OpenClKernel::setInputComputeTypes(const Pothos::ObjectKwargs &types)
+{
+    for (const auto &pair : types)
+    {
+        const auto pairArgs = pair.second.convert<Pothos::ObjectVector>();
+        if (pairArgs.size() != 2) throw Pothos::Exception("OpenClKernel::setInputComputeTypes()", "expected [dtype, scale] for "+pair.first);
+        this->setInputComputeType(Poco::NumberParser::parseUnsigned(pair.first), pairArgs[0].convert<std::string>(), pairArgs[1].convert<double>());
+    }
+}
 
-    /* Create ports */
-    _myDomain = "OpenCl_"+std::to_string(size_t(_device));
-    for (size_t i = 0; i < inputTypes.size(); i++)
+void OpenClKernel::setOutputComputeTypes(const Pothos::ObjectKwargs &types)
+{
+    for (const auto &pair : types)
     {
-        this->setupInput(i, Pothos::DType(inputTypes[i]), _myDomain);
+        const auto pairArgs = pair.second.convert<Pothos::ObjectVector>();
+        if (pairArgs.size() != 2) throw Pothos::Exception("OpenClKernel::setOutputComputeTypes()", "expected [dtype, scale] for "+pair.first);
+        this->setOutputComputeType(Poco::NumberParser::parseUnsigned(pair.first), pairArgs[0].convert<std::string>(), pairArgs[1].convert<double>());
     }
-    for (size_t i = 0; i < outputTypes.size(); i++)
+}
+
+void OpenClKernel::updateKernel(void)
+{
+    //the defines are part of the options, so each specialization is cached separately
+    ProgramBuild build;
+    build.kernelName = _kernelName;
+    build.chainNames = _chainNames;
+    build.source = _kernelSource;
+    build.options = _buildOptions;
+    build.launchState = _launchState;
+    for (const auto &pair : _defines)
     {
-        this->setupOutput(i, Pothos::DType(outputTypes[i]), _myDomain);
+        build.options += " -D " + pair.first;
+        if (not pair.second.empty()) build.options += "=" + pair.second;
     }
 
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setSource));
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setLocalSize));
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getLocalSize));
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setGlobalFactor));
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getGlobalFactor));
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, setProductionFactor));
-    this->registerCall(this, POTHOS_FCN_TUPLE(OpenClKernel, getProductionFactor));
+    //build the programs on a worker thread, so the caller and the stream are not stalled,
+    //the thread holds its own references to the contexts, and blocks build in parallel
+    std::vector<std::pair<std::shared_ptr<cl_context>, cl_device_id>> targets(1, std::make_pair(_context, _device));
+    for (const auto &secondary : _secondaries) targets.emplace_back(secondary.context, secondary.device);
+    //a build that is still pending is set aside instead of waited on, and its result is discarded,
+    //the futures of std::async block on destruction, so they are only released once ready
+    _supersededBuilds.erase(std::remove_if(_supersededBuilds.begin(), _supersededBuilds.end(),
+        [](const std::future<ProgramBuild> &f){return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;}),
+        _supersededBuilds.end());
+    if (_pendingBuild.valid()) _supersededBuilds.push_back(std::move(_pendingBuild));
+    _pendingBuild = std::async(std::launch::async, [build, targets](void) mutable
+    {
+        /* Create and build program, or share one already built for this context */
+        build.program = lookupProgramCache(targets[0].first, targets[0].second, build.source, build.options);
+
+        /* Build the same program for the additional devices */
+        for (size_t d = 1; d < targets.size(); d++)
+        {
+            build.secondaryPrograms.push_back(lookupProgramCache(targets[d].first, targets[d].second, build.source, build.options));
+        }
+        return build;
+    });
 }
 
-void OpenClKernel::setSource(const std::string &kernelName, const std::string &kernelSource_)
+void OpenClKernel::applyProgramBuild(const bool wait)
 {
+    if (not _pendingBuild.valid()) return;
+    if (not wait and _pendingBuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+
+    //a build error is thrown here, to the caller of work() or activate(),
+    //and the previous kernel remains in use
+    const auto build = _pendingBuild.get();
     cl_int err = 0;
 
-    //load kernel source from file if it ends in .cl
-    auto kernelSource = kernelSource_;
-    if (kernelSource.size() > 3 and kernelSource.substr(kernelSource.size()-3) == ".cl")
+    /* Create the kernels */
+    auto kernel = clCreateKernel(*build.program, build.kernelName.c_str(), &err);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateKernel()", clErrToStr(err));
+    std::shared_ptr<cl_kernel> kernelSptr(new cl_kernel(kernel), clReleaseKernelPtr);
+
+    //the stages of a kernel chain are kernels of the same program as the first kernel
+    std::vector<std::shared_ptr<cl_kernel>> chainKernels;
+    for (const auto &name : build.chainNames)
     {
-        std::cout << "OpenClKernel block loading " << kernelSource << "..." << std::endl;
-        std::ifstream t(kernelSource);
-        if (not t.good()) throw Pothos::Exception("OpenClKernel::setSource("+kernelSource+")", "cant read file");
-        kernelSource = std::string((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+        auto kernel = clCreateKernel(*build.program, name.c_str(), &err);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateKernel("+name+")", clErrToStr(err));
+        chainKernels.emplace_back(new cl_kernel(kernel), clReleaseKernelPtr);
     }
 
-    /* Create program from source */
-    if (kernelSource.empty()) throw Pothos::Exception("OpenClKernel::setSource()", "no source specified");
-    const char *sourcePtr = kernelSource.data();
-    const size_t sourceSize = kernelSource.size();
-    auto program = clCreateProgramWithSource(*_context, 1, &sourcePtr, &sourceSize, &err);
-    if(err < 0) throw Pothos::Exception("OpenClKernel::clCreateProgramWithSource()", clErrToStr(err));
-    _program.reset(new cl_program(program), clReleaseProgramPtr);
-
-    /* Build program */
-    err = clBuildProgram(*_program, 0, nullptr, nullptr, nullptr, nullptr);
-    if (err < 0)
+    std::vector<std::shared_ptr<cl_kernel>> secondaryKernels;
+    for (const auto &program : build.secondaryPrograms)
     {
-        /* Find size of log and print to std output */
-        size_t logSize = 0;
-        clGetProgramBuildInfo(*_program, _device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
-        std::vector<char> errorLog(logSize);
-        clGetProgramBuildInfo(*_program, _device, CL_PROGRAM_BUILD_LOG, logSize, errorLog.data(), nullptr);
+        auto kernel = clCreateKernel(*program, build.kernelName.c_str(), &err);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateKernel()", clErrToStr(err));
+        secondaryKernels.emplace_back(new cl_kernel(kernel), clReleaseKernelPtr);
+    }
 
-        std::string errorString(errorLog.begin(), errorLog.end());
-        throw Pothos::Exception("OpenClKernel::clBuildProgram()", errorString);
+    /* Swap in the new kernels, launches in flight hold the previous ones */
+    _program = build.program;
+    _kernel = kernelSptr;
+    _chainKernels = chainKernels;
+    this->updateChainTypes();
+    for (size_t d = 0; d < _secondaries.size(); d++)
+    {
+        _secondaries[d].program = build.secondaryPrograms[d];
+        _secondaries[d].kernel = secondaryKernels[d];
     }
 
-    /* Create a command queue */
-    auto queue = clCreateCommandQueue(*_context, _device, 0, &err);
-    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateCommandQueue()", clErrToStr(err));
-    _queue.reset(new cl_command_queue(queue), clReleaseCommandQueuePtr);
+    //launch state coupled to the defines takes effect with the kernel built from them
+    _launchState = nullptr;
+    if (build.launchState) build.launchState();
 
-    /* Create a kernel */
-    auto kernel = clCreateKernel(*_program, kernelName.c_str(), &err);
-    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateKernel()", clErrToStr(err));
-    _kernel.reset(new cl_kernel(kernel), clReleaseKernelPtr);
+    //tuned local sizes are specific to the device, driver, and kernel build
+    char deviceName[1024], driverVersion[1024];
+    clGetDeviceInfo(_device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, nullptr);
+    clGetDeviceInfo(_device, CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, nullptr);
+    Poco::MD5Engine md5;
+    md5.update(build.source);
+    md5.update(build.options);
+    _tunerKey = std::string(deviceName) + "|" + driverVersion + "|" + build.kernelName + "|" + Poco::DigestEngine::digestToHex(md5.digest());
+    _tuner.reset();
 }
 
-void OpenClKernel::work(void)
+std::shared_ptr<cl_mem> OpenClKernel::acquireStaging(std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> &buffers, const size_t numBytes)
 {
-    const auto &inputs = this->inputs();
-    const auto &outputs = this->outputs();
+    //find a staging buffer that is not held by a launch in flight or a history tail,
+    //free buffers that are too small are dropped in favor of a larger one
+    for (auto it = buffers.begin(); it != buffers.end();)
+    {
+        if (it->second.use_count() != 1) ++it;
+        else if (it->first < numBytes) it = buffers.erase(it);
+        else return it->second;
+    }
 
-    std::vector<cl_mem> inputBuffs(inputs.size());
-    std::vector<cl_mem> outputBuffs(outputs.size());
+    size_t size = 1;
+    while (size < numBytes) size *= 2;
+    cl_int err = 0;
+    auto memobj = clCreateBuffer(*_context, CL_MEM_READ_WRITE, size, nullptr, &err);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::acquireStaging::clCreateBuffer()", clErrToStr(err));
+    std::shared_ptr<cl_mem> staging(new cl_mem(memobj), clReleaseMemObjectPtr);
+    buffers.emplace_back(size, staging);
+    return staging;
+}
+
+cl_event OpenClKernel::enqueuePortConvert(const PortConversion &conversion, cl_mem in, const void *inSvm, const size_t inOffset,
+    cl_mem out, const void *outSvm, const size_t numScalars, const std::vector<cl_event> &waitList)
+{
+    cl_kernel kernel = *conversion.kernel;
+    const cl_uint offset = inOffset;
+    const cl_float scale = conversion.scale;
+    cl_int err = (inSvm != nullptr)?setClKernelArgSvm(kernel, 0, inSvm):clSetKernelArg(kernel, 0, sizeof(cl_mem), &in);
+    if (err == 0) err = (outSvm != nullptr)?setClKernelArgSvm(kernel, 1, outSvm):clSetKernelArg(kernel, 1, sizeof(cl_mem), &out);
+    if (err == 0) err = clSetKernelArg(kernel, 2, sizeof(offset), &offset);
+    if (err == 0) err = clSetKernelArg(kernel, 3, sizeof(scale), &scale);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::enqueuePortConvert::clSetKernelArg()", clErrToStr(err));
+
+    cl_event event;
+    err = clEnqueueNDRangeKernel(*_queue, kernel, 1, nullptr, &numScalars, nullptr,
+        waitList.size(), waitList.empty()?nullptr:waitList.data(), &event);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::enqueuePortConvert::enqueueKernel()", clErrToStr(err));
+    return event;
+}
 
+void OpenClKernel::stageHistory(const size_t index, Launch &launch, const size_t numElems,
+    cl_mem &buff, size_t &offset, const std::shared_ptr<cl_event> &inputEvent, std::vector<cl_event> &waitList)
+{
+    auto &history = _histories[index];
+    const size_t elemSize = this->input(index)->dtype().size();
+    const size_t historyBytes = history.numElems*elemSize;
+    const size_t newBytes = numElems*elemSize;
     cl_int err = 0;
 
-    if (this->workInfo().minElements == 0) return;
+    auto staging = this->acquireStaging(history.buffers, historyBytes+newBytes);
+    launch.scratch.push_back(staging);
 
-    //calculate number of elements
-    size_t inputElems = this->workInfo().minInElements;
-    size_t outputElems = this->workInfo().minOutElements;
-    if (_productionFactor > 1.0)
+    //the history comes from the tail of the last staging buffer, or zeros to start
+    cl_event historyEvent;
+    if (history.tail)
     {
-        outputElems = std::min<size_t>(inputElems*_productionFactor, outputElems);
-        inputElems = outputElems/_productionFactor;
+        launch.scratch.push_back(history.tail);
+        err = clEnqueueCopyBuffer(*_queue, *history.tail, *staging, history.tailOffset, 0, historyBytes,
+            history.tailEvent?1:0, history.tailEvent?history.tailEvent.get():nullptr, &historyEvent);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::stageHistory::clEnqueueCopyBuffer()", clErrToStr(err));
     }
     else
     {
-        inputElems = std::min<size_t>(outputElems/_productionFactor, inputElems);
-        outputElems = inputElems*_productionFactor;
+        const std::vector<char> zeros(historyBytes, 0);
+        err = clEnqueueWriteBuffer(*_queue, *staging, CL_TRUE, 0, historyBytes, zeros.data(), 0, nullptr, &historyEvent);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::stageHistory::clEnqueueWriteBuffer()", clErrToStr(err));
     }
-    size_t globalSize = inputElems*_globalFactor;
+    launch.events.emplace_back(new cl_event(historyEvent), clReleaseEventPtr);
 
-    /* Create data buffer */
-    size_t argNo = 0;
-    for (size_t i = 0; i < inputs.size(); i++)
-    {
-        inputBuffs[i] = getClBufferFromManaged(inputs[i]->buffer().getManagedBuffer());
-        err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), &inputBuffs[i]);
-        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
-    }
-    for (size_t i = 0; i < outputs.size(); i++)
+    //the new elements follow the history, this copy waits on the history copy,
+    //so that its event covers the entire staging buffer
+    std::vector<cl_event> copyWaitList(1, historyEvent);
+    if (inputEvent) copyWaitList.push_back(*inputEvent);
+    cl_event copyEvent;
+    err = clEnqueueCopyBuffer(*_queue, buff, *staging, offset, historyBytes, newBytes,
+        copyWaitList.size(), copyWaitList.data(), &copyEvent);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::stageHistory::clEnqueueCopyBuffer()", clErrToStr(err));
+    launch.events.emplace_back(new cl_event(copyEvent), clReleaseEventPtr);
+    waitList.push_back(copyEvent);
+
+    history.tail = staging;
+    history.tailOffset = newBytes;
+    history.tailEvent = launch.events.back();
+    buff = *staging;
+    offset = 0;
+}
+
+void OpenClKernel::bindKernelArgs(cl_kernel kernel, const size_t firstIndex, const size_t deviceIndex)
+{
+    for (const auto &pair : _kernelArgs)
     {
-        outputBuffs[i] = getClBufferFromManaged(outputs[i]->buffer().getManagedBuffer());
-        err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), &outputBuffs[i]);
-        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+        const auto &arg = pair.second;
+        if (pair.first < firstIndex) throw Pothos::Exception("OpenClKernel::work()",
+            "argument "+std::to_string(pair.first)+" is already bound to a port buffer or extent");
+        cl_int err = 0;
+        if (not arg.memobjs.empty()) err = clSetKernelArg(kernel, pair.first, sizeof(cl_mem), arg.memobjs[deviceIndex].get());
+        else if (arg.localSize != 0) err = clSetKernelArg(kernel, pair.first, arg.localSize, nullptr);
+        else err = clSetKernelArg(kernel, pair.first, arg.value.size(), arg.value.data());
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg("+std::to_string(pair.first)+")", clErrToStr(err));
     }
+}
 
-    /* Enqueue kernel */
-    err = clEnqueueNDRangeKernel(*_queue, *_kernel, 1, nullptr, &globalSize, &_localSize, 0, nullptr, nullptr);
-    if (err < 0) throw Pothos::Exception("OpenClKernel::work::enqueueKernel()", clErrToStr(err));
+/***********************************************************************
+ * Multi-device splitting
+ **********************************************************************/
+static const size_t MIN_SPLIT_ELEMS = 256;
 
-    /* Read the kernel's output */
-    for (size_t i = 0; i < inputs.size(); i++)
+std::vector<size_t> OpenClKernel::splitElements(const size_t numElems, const size_t localSize)
+{
+    std::vector<size_t> split(_deviceRates.size(), 0);
+    split[0] = numElems;
+
+    //the primary keeps at least one work-group, small launches are not worth splitting
+    const size_t minPrimary = std::max<size_t>(localSize, 1);
+    if (numElems < minPrimary+MIN_SPLIT_ELEMS) return split;
+
+    //devices without a measurement yet are given the best known rate
+    double bestRate = 0.0;
+    for (const auto rate : _deviceRates) bestRate = std::max(bestRate, rate);
+    if (bestRate == 0.0) bestRate = 1.0;
+    double totalRate = 0.0;
+    for (const auto rate : _deviceRates) totalRate += (rate == 0.0)?bestRate:rate;
+
+    for (size_t d = 1; d < split.size(); d++)
     {
-        inputs[i]->consume(inputElems);
+        const double rate = (_deviceRates[d] == 0.0)?bestRate:_deviceRates[d];
+        const size_t n = size_t(numElems*rate/totalRate);
+        if (n < MIN_SPLIT_ELEMS or n > split[0]-minPrimary) continue;
+        split[d] = n;
+        split[0] -= n;
     }
-    for (size_t i = 0; i < outputs.size(); i++)
+
+    //the primary share is a multiple of its local size, the extra goes to another device
+    for (size_t d = 1; localSize != 0 and d < split.size(); d++)
     {
-        err = clEnqueueReadBuffer(*_queue, outputBuffs[i], CL_TRUE, 0,
-            outputElems*outputs[i]->dtype().size(), outputs[i]->buffer().as<void *>(), 0, nullptr, nullptr);
-        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueReadBuffer()", clErrToStr(err));
-        outputs[i]->produce(outputElems);
+        if (split[d] == 0) continue;
+        const size_t extra = split[0] % localSize;
+        split[0] -= extra;
+        split[d] += extra;
+        break;
     }
+    return split;
 }
 
-static Pothos::BlockRegistry registerOpenClKernel(
-    "/blocks/opencl_kernel", &OpenClKernel::make);
+void OpenClKernel::updateRate(const size_t deviceIndex, const double rate)
+{
+    auto &deviceRate = _deviceRates[deviceIndex];
+    deviceRate = (deviceRate == 0.0)?rate:(0.75*deviceRate + 0.25*rate);
+}
+
+static cl_mem ensureBufferSize(std::pair<size_t, std::shared_ptr<cl_mem>> &buffer, cl_context context, const cl_mem_flags flags, const size_t size)
+{
+    if (buffer.first >= size and buffer.second) return *buffer.second;
+    cl_int err = 0;
+    auto memobj = clCreateBuffer(context, flags, size, nullptr, &err);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateBuffer()", clErrToStr(err));
+    buffer.first = size;
+    buffer.second.reset(new cl_mem(memobj), clReleaseMemObjectPtr);
+    return memobj;
+}
+
+/***********************************************************************
+ * A user event of one context that completes with an event of another,
+ * so that commands on different contexts are chained without blocking
+ **********************************************************************/
+static void CL_CALLBACK completeLinkedEvent(cl_event, cl_int status, void *userData)
+{
+    auto userEvent = static_cast<cl_event>(userData);
+    clSetUserEventStatus(userEvent, (status < 0)?status:CL_COMPLETE);
+    clReleaseEvent(userEvent);
+}
+
+static std::shared_ptr<cl_event> makeLinkedEvent(cl_context context, cl_event event)
+{
+    cl_int err = 0;
+    auto userEvent = clCreateUserEvent(context, &err);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateUserEvent()", clErrToStr(err));
+    std::shared_ptr<cl_event> userEventSptr(new cl_event(userEvent), clReleaseEventPtr);
+
+    //the callback holds its own reference until it completes the user event
+    clRetainEvent(userEvent);
+    err = clSetEventCallback(event, CL_COMPLETE, &completeLinkedEvent, userEvent);
+    if (err < 0)
+    {
+        clSetUserEventStatus(userEvent, err);
+        clReleaseEvent(userEvent);
+        throw Pothos::Exception("OpenClKernel::clSetEventCallback()", clErrToStr(err));
+    }
+    return userEventSptr;
+}
+
+/***********************************************************************
+ * The profiled time from the start of one command to the end of another
+ **********************************************************************/
+static double profiledSeconds(cl_event startEvent, cl_event endEvent)
+{
+    cl_ulong start = 0, end = 0;
+    cl_int err = clGetEventProfilingInfo(startEvent, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+    if (err == 0) err = clGetEventProfilingInfo(endEvent, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+    if (err < 0 or end <= start) return 0.0;
+    return (end-start)/1e9;
+}
+
+void OpenClKernel::enqueueSecondary(SecondaryDevice &secondary, const size_t deviceIndex, Launch &launch, const size_t first, const size_t numElems,
+    const std::vector<cl_mem> &inputBuffs, const std::vector<size_t> &inputOffsets, const std::vector<cl_event> &waitList)
+{
+    const auto &inputs = this->inputs();
+    const auto &outputs = this->outputs();
+    SecondaryLaunch share;
+    share.deviceIndex = deviceIndex;
+    share.first = first;
+    share.numElems = numElems;
+
+    //the events of this device, the first and last bound its profiled time
+    std::vector<std::shared_ptr<cl_event>> events;
+    const auto addEvent = [&](cl_event event)
+    {
+        events.emplace_back(new cl_event(event), clReleaseEventPtr);
+        if (not share.startEvent) share.startEvent = events.back();
+        share.endEvent = events.back();
+    };
+
+    cl_int err = 0;
+    size_t argNo = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        const size_t elemSize = inputs[i]->dtype().size();
+        const size_t numBytes = numElems*elemSize;
+        cl_mem memobj = ensureBufferSize(secondary.inputs[i], *secondary.context, CL_MEM_READ_ONLY, numBytes);
+
+        //uploaded inputs are copied from host memory directly, the launch holds the chunk,
+        //device resident inputs are read back from the primary device, and the
+        //upload waits on that read through a user event of this device's context
+        const auto &chunk = launch.inputs[i];
+        const void *src = reinterpret_cast<const void *>(chunk.address + first*elemSize);
+        std::shared_ptr<cl_event> readEvent;
+        if (not isClHostValidFromChunk(chunk))
+        {
+            launch.hostStaging.emplace_back(numBytes);
+            cl_event event;
+            err = clEnqueueReadBuffer(*_queue, inputBuffs[i], CL_FALSE, inputOffsets[i]+first*elemSize, numBytes,
+                launch.hostStaging.back().data(), waitList.size(), waitList.empty()?nullptr:waitList.data(), &event);
+            if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueReadBuffer()", clErrToStr(err));
+            launch.events.emplace_back(new cl_event(event), clReleaseEventPtr);
+            readEvent = makeLinkedEvent(*secondary.context, event);
+            src = launch.hostStaging.back().data();
+        }
+
+        cl_event event;
+        err = clEnqueueWriteBuffer(*secondary.queue, memobj, CL_FALSE, 0, numBytes, src,
+            readEvent?1:0, readEvent?readEvent.get():nullptr, &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueWriteBuffer()", clErrToStr(err));
+        addEvent(event);
+        err = clSetKernelArg(*secondary.kernel, argNo++, sizeof(cl_mem), &memobj);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const size_t numBytes = numElems*outputs[i]->dtype().size();
+        cl_mem memobj = ensureBufferSize(secondary.outputs[i], *secondary.context, CL_MEM_WRITE_ONLY, numBytes);
+        err = clSetKernelArg(*secondary.kernel, argNo++, sizeof(cl_mem), &memobj);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    for (size_t i = 0; _bufferMode == "CIRCULAR" and i < inputs.size(); i++)
+    {
+        const cl_uint offset = 0;
+        err = clSetKernelArg(*secondary.kernel, argNo++, sizeof(offset), &offset);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    this->bindKernelArgs(*secondary.kernel, argNo, deviceIndex);
+
+    cl_event kernelEvent;
+    err = clEnqueueNDRangeKernel(*secondary.queue, *secondary.kernel, 1, nullptr, &numElems, nullptr, 0, nullptr, &kernelEvent);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::work::enqueueKernel()", clErrToStr(err));
+    addEvent(kernelEvent);
+
+    //read the outputs into host staging, they are written to the primary device by finishSecondary()
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const size_t numBytes = numElems*outputs[i]->dtype().size();
+        share.outputStaging.push_back(launch.hostStaging.size());
+        launch.hostStaging.emplace_back(numBytes);
+        cl_event event;
+        err = clEnqueueReadBuffer(*secondary.queue, *secondary.outputs[i].second, CL_FALSE, 0, numBytes,
+            launch.hostStaging.back().data(), 0, nullptr, &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueReadBuffer()", clErrToStr(err));
+        addEvent(event);
+    }
+
+    //the queue is in order: the last command completes after all of them,
+    //and the launch does not complete until then, even without outputs
+    share.doneEvent = makeLinkedEvent(*_context, *share.endEvent);
+    launch.events.push_back(share.doneEvent);
+    launch.secondaryLaunches.push_back(share);
+
+    err = clFlush(*secondary.queue);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::work::clFlush()", clErrToStr(err));
+}
+
+void OpenClKernel::finishSecondary(Launch &launch, const SecondaryLaunch &share, const std::vector<cl_mem> &outputBuffs)
+{
+    const auto &outputs = this->outputs();
+    cl_int err = 0;
+
+    //each write waits on the last, so the final write implies the primary kernel and all writes,
+    //the first write also waits on the outputs of the additional device in host staging
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const size_t elemSize = outputs[i]->dtype().size();
+        const cl_event waitList[2] = {*launch.outputEvent, *share.doneEvent};
+        cl_event event;
+        err = clEnqueueWriteBuffer(*_queue, outputBuffs[i], CL_FALSE, share.first*elemSize, share.numElems*elemSize,
+            launch.hostStaging[share.outputStaging[i]].data(), 2, waitList, &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueWriteBuffer()", clErrToStr(err));
+        launch.outputEvent.reset(new cl_event(event), clReleaseEventPtr);
+        launch.events.push_back(launch.outputEvent);
+    }
+}
+
+bool OpenClKernel::isLaunchComplete(const Launch &launch)
+{
+    for (const auto &event : launch.events)
+    {
+        cl_int status = CL_COMPLETE;
+        const cl_int err = clGetEventInfo(*event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::clGetEventInfo()", clErrToStr(err));
+        if (status < 0) throw Pothos::Exception("OpenClKernel::work()", clErrToStr(status));
+        if (status != CL_COMPLETE) return false;
+    }
+    return true;
+}
+
+void OpenClKernel::waitLaunch(const Launch &launch)
+{
+    std::vector<cl_event> events;
+    for (const auto &event : launch.events) events.push_back(*event);
+    if (events.empty()) return;
+    const cl_int err = clWaitForEvents(events.size(), events.data());
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clWaitForEvents()", clErrToStr(err));
+}
+
+void OpenClKernel::postLaunch(Launch &launch)
+{
+    const auto &outputs = this->outputs();
+
+    //packet mode emits the output packets and other messages in the order of the input
+    if (_packetMode)
+    {
+        for (size_t i = 0; i < launch.messages.size(); i++)
+        {
+            for (const auto &msg : launch.messages[i]) outputs[i]->postMessage(msg);
+        }
+        launch.messages.clear();
+        launch.posted = true;
+        return;
+    }
+
+    //post the output buffers and their labels,
+    //label indexes are relative to what was already posted in this call
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        //variable outputs are trimmed to the count written by the kernel
+        const size_t elemSize = outputs[i]->dtype().size();
+        if (not launch.counts.empty())
+        {
+            const size_t numElems = std::min<size_t>(launch.counts[i], launch.outputs[i].length/elemSize);
+            launch.outputs[i].length = numElems*elemSize;
+        }
+
+        //labels of variable outputs are clamped to the produced elements
+        const size_t numElems = launch.outputs[i].length/elemSize;
+        launch.postOffsets[i] = _postedElems[i];
+        for (auto label : launch.labels)
+        {
+            if (not launch.counts.empty()) label.index = std::min<unsigned long long>(label.index, (numElems == 0)?0:numElems-1);
+            label.index += launch.postOffsets[i];
+            outputs[i]->postLabel(label);
+        }
+        getClEventFromManaged(launch.outputs[i].getManagedBuffer()) = launch.outputEvent;
+        _postedElems[i] += numElems;
+        if (numElems != 0) outputs[i]->postBuffer(launch.outputs[i]);
+    }
+    launch.labels.clear();
+    launch.posted = true;
+}
+
+void OpenClKernel::retireLaunch(void)
+{
+    const auto &launch = _launches.front();
+    if (not launch->posted) this->postLaunch(*launch);
+
+    //the launch has completed, feed its kernel time to the tuner
+    if (_tuner and launch->tuneLocalSize != 0)
+    {
+        _tuner->record(launch->tuneGlobalSize, launch->tuneOtherItems, launch->tuneLocalSize, launch->tuneWorkItems, *launch->kernelEvent);
+    }
+
+    //the launch has completed, measure the device rates for splitting
+    //from the profiled commands that each device ran for its share
+    if (not _secondaries.empty() and launch->primaryElems != 0)
+    {
+        const double seconds = profiledSeconds(*launch->kernelEvent, *launch->kernelEvent);
+        if (seconds > 0.0) this->updateRate(0, launch->primaryElems/seconds);
+    }
+    for (const auto &share : launch->secondaryLaunches)
+    {
+        const double seconds = profiledSeconds(*share.startEvent, *share.endEvent);
+        if (seconds > 0.0) this->updateRate(share.deviceIndex, share.numElems/seconds);
+    }
+
+    //releasing the launch returns its input buffers to the upstream manager
+    _launches.pop_front();
+}
+
+Pothos::BufferManager::Sptr OpenClKernel::makeBufferManager(const cl_mem_flags memFlags, const cl_map_flags mapFlags, const std::string &mode)
+{
+    //the queue is created once, buffer managers and launches must share it
+    if (not _queue) this->updateQueue();
+
+    OpenClBufferContainerArgs args;
+    args.mem_flags = memFlags;
+    args.map_flags = mapFlags;
+    args.context = _context;
+    args.device = _device;
+    args.queue = _queue;
+    args.profiler = _profiler;
+    args.arenaPool = _arenaPool;
+    Pothos::BufferManager::Sptr manager;
+    if (mode == "CIRCULAR") manager = makeOpenClCircularBufferManager(args);
+    else if (mode == "SVM") manager = makeOpenClSvmBufferManager(args);
+    else if (mode == "DISCRETE") manager = makeOpenClUnifiedBufferManager(args);
+    else manager = makeOpenClBufferManager(args);
+
+    //initialize with the configured size, otherwise the framework uses its defaults
+    if (_bufferSize != 0)
+    {
+        Pothos::BufferManagerArgs managerArgs;
+        managerArgs.bufferSize = _bufferSize;
+        manager->init(managerArgs);
+    }
+    return manager;
+}
+
+void OpenClKernel::updateQueue(void)
+{
+    //profiling is always enabled, so the tuner, the profiler, and the device rates
+    //can be switched on by a setter without replacing the queue of a committed block
+    cl_command_queue_properties properties = CL_QUEUE_PROFILING_ENABLE;
+    if (_queueMode == "OUT_OF_ORDER") properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+
+    if (_queueMode == "PRIVATE") _queue = makeCommandQueue(_context, _device, properties);
+    else _queue = lookupQueueCache(_context, _device, properties);
+    _arenaPool = lookupOpenClArenaPool(_context, _queue);
+}
+
+void OpenClKernel::setQueueMode(const std::string &mode)
+{
+    if (mode != "PRIVATE" and mode != "SHARED" and mode != "OUT_OF_ORDER")
+    {
+        throw Pothos::Exception("OpenClKernel::setQueueMode("+mode+")", "unknown queue mode");
+    }
+    if (_queue and mode != _queueMode)
+    {
+        throw Pothos::Exception("OpenClKernel::setQueueMode("+mode+")", "cannot change the queue mode once buffers are allocated");
+    }
+    _queueMode = mode;
+}
+
+/***********************************************************************
+ * Scale an element count by a factor such as 1/D, rounding down,
+ * with a tolerance so that exact multiples are not truncated by the
+ * floating point error of the factor, example: 98*(1.0/49) == 1.999...
+ **********************************************************************/
+static size_t scaleElems(const size_t numElems, const double factor)
+{
+    return size_t(numElems*factor + 1e-6);
+}
+
+void OpenClKernel::work(void)
+{
+    const auto &inputs = this->inputs();
+    const auto &outputs = this->outputs();
+
+    std::vector<cl_mem> inputBuffs(inputs.size());
+    std::vector<size_t> inputOffsets(inputs.size());
+    std::vector<cl_mem> outputBuffs(outputs.size());
+
+    cl_int err = 0;
+
+    _labelLaunch.reset();
+    _postedElems.assign(outputs.size(), 0);
+
+    //swap in a kernel built in the background, only the first build is waited on
+    this->applyProgramBuild(not _kernel);
+
+    //produce launches that have already completed
+    while (not _launches.empty() and this->isLaunchComplete(*_launches.front()))
+    {
+        this->retireLaunch();
+    }
+
+    if (_packetMode) return this->workPackets();
+
+    //nothing to launch: drain the oldest launch in flight
+    if (this->workInfo().minElements == 0)
+    {
+        if (_launches.empty()) return;
+        this->waitLaunch(*_launches.front());
+        this->retireLaunch();
+        if (not _launches.empty()) this->yield();
+        return;
+    }
+
+    //calculate number of elements
+    size_t inputElems = this->workInfo().minInElements;
+    size_t outputElems = this->workInfo().minOutElements;
+    if (_productionFactor > 1.0)
+    {
+        outputElems = std::min(scaleElems(inputElems, _productionFactor), outputElems);
+        inputElems = scaleElems(outputElems, 1.0/_productionFactor);
+    }
+    else
+    {
+        inputElems = std::min(scaleElems(outputElems, 1.0/_productionFactor), inputElems);
+        outputElems = scaleElems(inputElems, _productionFactor);
+    }
+
+    //wait for the minimum batch when the input is the limit, until the timeout expires
+    if (inputElems < _minBatch and this->workInfo().minInElements < _minBatch)
+    {
+        const auto now = std::chrono::high_resolution_clock::now();
+        if (not _batchWaiting) _batchWaitStart = now;
+        _batchWaiting = true;
+        const std::chrono::duration<double> remaining = std::chrono::duration<double>(_batchTimeout) - (now - _batchWaitStart);
+        //dont block the scheduler: work() is called again when more input arrives,
+        //or after the scheduler's timeout (workInfo().maxTimeoutNs) to check the time
+        if (remaining.count() > 0.0) return;
+    }
+    _batchWaiting = false;
+
+    //bound the batch size for latency
+    if (_maxBatch != 0 and inputElems > _maxBatch)
+    {
+        inputElems = _maxBatch;
+        outputElems = scaleElems(inputElems, _productionFactor);
+    }
+    size_t globalSize = scaleElems(inputElems, _globalFactor);
+
+    //work-items that process several elements each only consume whole groups,
+    //unless a last partial work-item processes the remainder
+    if (_globalFactor < 1.0 and _partialWorkItems)
+    {
+        if (scaleElems(globalSize, 1.0/_globalFactor) < inputElems) globalSize++;
+    }
+    else if (_globalFactor < 1.0)
+    {
+        if (globalSize == 0) //wait for a whole group
+        {
+            if (not _launches.empty()) this->yield();
+            return;
+        }
+        inputElems = scaleElems(globalSize, 1.0/_globalFactor);
+        outputElems = scaleElems(inputElems, _productionFactor);
+    }
+
+    //the real extent of each dimension: the inner frame shape and the number of frames
+    std::vector<size_t> extents(1, globalSize);
+    if (not _frameShape.empty())
+    {
+        size_t frameElems = 1;
+        for (const auto dim : _frameShape) frameElems *= dim;
+        const size_t numFrames = globalSize/frameElems;
+        if (numFrames == 0) //wait for a whole frame
+        {
+            if (not _launches.empty()) this->yield();
+            return;
+        }
+
+        //only consume the elements of whole frames
+        globalSize = numFrames*frameElems;
+        inputElems = scaleElems(globalSize, 1.0/_globalFactor);
+        outputElems = scaleElems(inputElems, _productionFactor);
+        extents = _frameShape;
+        extents.push_back(numFrames);
+    }
+
+    //pad the global size up to a multiple of the local size in each dimension
+    const size_t workDim = extents.size();
+    std::vector<size_t> globalShape(workDim), localShape(workDim);
+    for (size_t d = 0; d < workDim; d++)
+    {
+        localShape[d] = (d < _localShape.size())?_localShape[d]:1;
+    }
+
+    //the tuner picks the local size of the first dimension,
+    //the other dimensions bound it to the work-group size of the kernel
+    const bool autoLocalSize = localShape[0] == 0;
+    const size_t tuneGlobalSize = extents[0];
+    size_t tuneOtherItems = 1;
+    for (size_t d = 1; d < workDim; d++) tuneOtherItems *= localShape[d];
+    if (autoLocalSize)
+    {
+        if (not _tuner) _tuner.reset(new OpenClLocalSizeTuner(*_kernel, _device, _tunerKey));
+        localShape[0] = _tuner->nextLocalSize(tuneGlobalSize, tuneOtherItems);
+
+        //one dimensional ranges only consume a multiple of the local size,
+        //a remainder smaller than the local size is left to the runtime
+        if (workDim == 1 and globalSize < localShape[0]) localShape[0] = 0;
+        else if (workDim == 1 and globalSize % localShape[0] != 0)
+        {
+            globalSize -= globalSize % localShape[0];
+            inputElems = scaleElems(globalSize, 1.0/_globalFactor);
+            outputElems = scaleElems(inputElems, _productionFactor);
+            extents[0] = globalSize;
+        }
+    }
+
+    for (size_t d = 0; d < workDim; d++)
+    {
+        globalShape[d] = extents[d];
+        if (workDim > 1) globalShape[d] = ((extents[d]+localShape[d]-1)/localShape[d])*localShape[d];
+    }
+
+    //split one dimensional launches across the devices, element i maps to output i
+    std::vector<size_t> split(1, globalShape[0]);
+    bool canSplit = not _secondaries.empty() and workDim == 1 and _globalFactor == 1.0 and _productionFactor == 1.0 and _bufferMode != "SVM";
+    for (const auto &history : _histories) canSplit = canSplit and history.numElems == 0;
+    for (const auto &conversion : _inputConversions) canSplit = canSplit and conversion.computeSize == 0;
+    for (const auto &conversion : _outputConversions) canSplit = canSplit and conversion.computeSize == 0;
+    canSplit = canSplit and not _variableOutput and _chainKernels.empty();
+    if (canSplit) split = this->splitElements(globalShape[0], localShape[0]);
+    globalShape[0] = split[0];
+
+    this->prepareLaunch(inputElems);
+
+    std::shared_ptr<Launch> launch(new Launch());
+    launch->posted = false;
+    launch->postOffsets.resize(outputs.size());
+    launch->tuneGlobalSize = tuneGlobalSize;
+    launch->tuneLocalSize = autoLocalSize?localShape[0]:0;
+    launch->tuneOtherItems = tuneOtherItems;
+    launch->tuneWorkItems = 1;
+    for (const auto size : globalShape) launch->tuneWorkItems *= size;
+    launch->primaryElems = (split.size() > 1)?split[0]:0;
+
+    /* Create data buffer */
+    std::vector<cl_event> waitList;
+    std::vector<std::shared_ptr<cl_mem>> outputStaging(outputs.size());
+    std::vector<size_t> wrappedInputs;
+    size_t argNo = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        //wait on the upload or upstream kernel that produced this buffer
+        const auto &buffer = inputs[i]->buffer();
+        auto inputEvent = getClEventFromManaged(buffer.getManagedBuffer());
+        const auto &conversion = _inputConversions[i];
+        const size_t firstWait = waitList.size();
+        launch->inputs.push_back(buffer);
+        inputBuffs[i] = getClBufferFromManaged(buffer.getManagedBuffer());
+        inputOffsets[i] = getClOffsetFromChunk(buffer);
+
+        //a window of a circular buffer that wraps past the end of the ring is made contiguous
+        const auto ringEvent = inputEvent;
+        err = enqueueClRingWrap(*_queue, buffer, inputElems*inputs[i]->dtype().size(), inputEvent);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::enqueueClRingWrap()", clErrToStr(err));
+        if (inputEvent != ringEvent)
+        {
+            launch->events.push_back(inputEvent);
+            wrappedInputs.push_back(i);
+        }
+
+        //shared virtual memory is bound by pointer, which includes the offset
+        const void *svmPtr = getClSvmPointerFromChunk(buffer);
+        if (svmPtr != nullptr)
+        {
+            if (_histories[i].numElems != 0) throw Pothos::Exception("OpenClKernel::work()", "input history is not supported with SVM buffers");
+            if (inputEvent) waitList.push_back(*inputEvent);
+            inputOffsets[i] = 0;
+        }
+
+        //the history and the new elements are copied into a staging buffer
+        else if (_histories[i].numElems != 0)
+        {
+            this->stageHistory(i, *launch, inputElems, inputBuffs[i], inputOffsets[i], inputEvent, waitList);
+        }
+
+        //the kernel has no offset argument for a partially consumed discrete buffer:
+        //copy the remainder on the device to the start of a pooled scratch buffer,
+        //unless the conversion below reads from the offset
+        else if (inputOffsets[i] != 0 and _bufferMode != "CIRCULAR" and conversion.computeSize == 0)
+        {
+            auto scratchSptr = this->acquireStaging(_scratchBuffers, buffer.length);
+            launch->scratch.push_back(scratchSptr);
+            cl_mem scratch = *scratchSptr;
+
+            cl_event event;
+            err = clEnqueueCopyBuffer(*_queue, inputBuffs[i], scratch, inputOffsets[i], 0, buffer.length,
+                inputEvent?1:0, inputEvent?inputEvent.get():nullptr, &event);
+            if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueCopyBuffer()", clErrToStr(err));
+            launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+            waitList.push_back(event);
+            inputBuffs[i] = scratch;
+            inputOffsets[i] = 0;
+        }
+        else if (inputEvent) waitList.push_back(*inputEvent);
+
+        //a narrow wire type is converted into a staging buffer of the compute type,
+        //the conversion waits on this input's events and the kernel waits on the conversion
+        if (conversion.computeSize != 0)
+        {
+            const size_t numElems = _histories[i].numElems + inputElems;
+            const size_t scalarSize = inputs[i]->dtype().size()/(inputs[i]->dtype().isComplex()?2:1);
+            auto staging = this->acquireStaging(_inputConversions[i].buffers, numElems*conversion.computeSize);
+            launch->scratch.push_back(staging);
+            const std::vector<cl_event> convertWaitList(waitList.begin()+firstWait, waitList.end());
+            const auto event = this->enqueuePortConvert(conversion, inputBuffs[i], svmPtr, inputOffsets[i]/scalarSize,
+                *staging, nullptr, numElems*inputs[i]->dtype().size()/scalarSize, convertWaitList);
+            launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+            waitList.resize(firstWait);
+            waitList.push_back(event);
+            inputBuffs[i] = *staging;
+            inputOffsets[i] = 0;
+            svmPtr = nullptr;
+        }
+
+        if (svmPtr != nullptr) err = setClKernelArgSvm(*_kernel, argNo++, svmPtr);
+        else err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), &inputBuffs[i]);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+
+    //a kernel chain writes its first intermediate result from the first kernel,
+    //and the block outputs from the last stage, following its input
+    cl_kernel outputKernel = _chainKernels.empty()?*_kernel:*_chainKernels.back();
+    size_t outputArgNo = _chainKernels.empty()?argNo:1;
+    std::vector<std::shared_ptr<cl_mem>> chainStaging;
+    for (size_t j = 0; j < _chainKernels.size(); j++)
+    {
+        chainStaging.push_back(this->acquireStaging(_chainBuffers[j], std::max<size_t>(outputElems*_chainTypes[j].size(), 1)));
+        launch->scratch.push_back(chainStaging.back());
+        if (j != 0) continue;
+        err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), chainStaging.front().get());
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const auto &buffer = outputs[i]->buffer();
+        outputBuffs[i] = getClBufferFromManaged(buffer.getManagedBuffer());
+
+        //a zero copy output waits on the unmap that returned it to the device
+        const auto &outputEvent = getClEventFromManaged(buffer.getManagedBuffer());
+        if (outputEvent and isClZeroCopyFromChunk(buffer)) waitList.push_back(*outputEvent);
+
+        //the kernel writes the compute type into a staging buffer, converted after the kernel
+        if (_outputConversions[i].computeSize != 0)
+        {
+            outputStaging[i] = this->acquireStaging(_outputConversions[i].buffers, outputElems*_outputConversions[i].computeSize);
+            launch->scratch.push_back(outputStaging[i]);
+            err = clSetKernelArg(outputKernel, outputArgNo++, sizeof(cl_mem), outputStaging[i].get());
+            if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+            continue;
+        }
+
+        const void *svmPtr = getClSvmPointerFromChunk(buffer);
+        if (svmPtr != nullptr)
+        {
+            err = setClKernelArgSvm(outputKernel, outputArgNo++, svmPtr);
+            if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArgSVMPointer()", clErrToStr(err));
+            continue;
+        }
+
+        err = clSetKernelArg(outputKernel, outputArgNo++, sizeof(cl_mem), &outputBuffs[i]);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    if (_chainKernels.empty()) argNo = outputArgNo;
+    for (size_t d = 0; workDim > 1 and d < workDim; d++)
+    {
+        const cl_uint extent = extents[d];
+        err = clSetKernelArg(*_kernel, argNo++, sizeof(extent), &extent);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    for (size_t i = 0; _bufferMode == "CIRCULAR" and i < inputs.size(); i++)
+    {
+        const cl_uint offset = inputOffsets[i]/inputs[i]->dtype().size();
+        err = clSetKernelArg(*_kernel, argNo++, sizeof(offset), &offset);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    std::shared_ptr<cl_mem> countBuffer;
+    if (_variableOutput)
+    {
+        //the counters start at zero, the host copy holds the counts once read back
+        launch->counts.assign(outputs.size(), 0);
+        countBuffer = this->acquireStaging(_countBuffers, std::max<size_t>(outputs.size(), 1)*sizeof(cl_uint));
+        launch->scratch.push_back(countBuffer);
+        cl_event event;
+        err = clEnqueueWriteBuffer(*_queue, *countBuffer, CL_FALSE, 0, launch->counts.size()*sizeof(cl_uint),
+            launch->counts.data(), 0, nullptr, &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueWriteBuffer()", clErrToStr(err));
+        launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+        waitList.push_back(event);
+        if (_chainKernels.empty()) err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), countBuffer.get());
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg()", clErrToStr(err));
+    }
+    this->bindKernelArgs(*_kernel, argNo, 0);
+
+    //start the shares of the additional devices, their inputs are
+    //read from the primary device before the primary kernel is enqueued
+    for (size_t d = 1, first = split[0]; d < split.size(); first += split[d++])
+    {
+        if (split[d] == 0) continue;
+        this->enqueueSecondary(_secondaries[d-1], d, *launch, first, split[d], inputBuffs, inputOffsets, waitList);
+    }
+    if (not launch->secondaryLaunches.empty())
+    {
+        //submit the reads of device resident inputs that the additional devices wait on
+        err = clFlush(*_queue);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clFlush()", clErrToStr(err));
+    }
+
+    /* Enqueue kernel */
+    cl_event kernelEvent;
+    err = clEnqueueNDRangeKernel(*_queue, *_kernel, workDim, nullptr, globalShape.data(), (localShape[0] == 0)?nullptr:localShape.data(),
+        waitList.size(), waitList.empty()?nullptr:waitList.data(), &kernelEvent);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::work::enqueueKernel()", clErrToStr(err));
+    launch->kernelEvent.reset(new cl_event(kernelEvent), clReleaseEventPtr);
+    launch->outputEvent = launch->kernelEvent;
+    launch->events.push_back(launch->kernelEvent);
+    if (_profiler) _profiler->record(OpenClProfiler::KERNEL, launch->kernelEvent);
+    for (const auto i : wrappedInputs) setClRingWrapReader(launch->inputs[i], launch->kernelEvent);
+
+    //the additional devices write their outputs into the primary's output buffers
+    for (const auto &share : launch->secondaryLaunches)
+    {
+        this->finishSecondary(*launch, share, outputBuffs);
+    }
+
+    //the remaining stages of a kernel chain run over the same range, each stage
+    //reads the intermediate result of the previous stage from device memory
+    for (size_t j = 0; j < _chainKernels.size(); j++)
+    {
+        cl_kernel kernel = *_chainKernels[j];
+        const bool isLast = j+1 == _chainKernels.size();
+        size_t stageArgNo = isLast?outputArgNo:2;
+        err = clSetKernelArg(kernel, 0, sizeof(cl_mem), chainStaging[j].get());
+        if (err == 0 and not isLast) err = clSetKernelArg(kernel, 1, sizeof(cl_mem), chainStaging[j+1].get());
+        for (size_t d = 0; err == 0 and workDim > 1 and d < workDim; d++)
+        {
+            const cl_uint extent = extents[d];
+            err = clSetKernelArg(kernel, stageArgNo++, sizeof(extent), &extent);
+        }
+        if (err == 0 and isLast and countBuffer) err = clSetKernelArg(kernel, stageArgNo++, sizeof(cl_mem), countBuffer.get());
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clSetKernelArg(stage "+std::to_string(j+1)+")", clErrToStr(err));
+
+        cl_event event;
+        err = clEnqueueNDRangeKernel(*_queue, kernel, workDim, nullptr, globalShape.data(), (localShape[0] == 0)?nullptr:localShape.data(),
+            1, launch->outputEvent.get(), &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::enqueueKernel(stage "+std::to_string(j+1)+")", clErrToStr(err));
+        launch->outputEvent.reset(new cl_event(event), clReleaseEventPtr);
+        launch->events.push_back(launch->outputEvent);
+        if (_profiler) _profiler->record(OpenClProfiler::KERNEL, launch->outputEvent);
+    }
+
+    //convert the outputs to their wire types, each conversion waits on the
+    //previous one, so the output event covers the kernel and all conversions
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        if (not outputStaging[i] or outputElems == 0) continue;
+        const auto &dtype = outputs[i]->dtype();
+        const size_t scalarSize = dtype.size()/(dtype.isComplex()?2:1);
+        const auto event = this->enqueuePortConvert(_outputConversions[i], *outputStaging[i], nullptr, 0,
+            outputBuffs[i], getClSvmPointerFromChunk(outputs[i]->buffer()), outputElems*dtype.size()/scalarSize,
+            std::vector<cl_event>(1, *launch->outputEvent));
+        launch->outputEvent.reset(new cl_event(event), clReleaseEventPtr);
+        launch->events.push_back(launch->outputEvent);
+    }
+    const size_t numDeviceEvents = launch->events.size();
+
+    /* Read the kernel's output */
+    if (countBuffer)
+    {
+        //the counts are read back alongside the outputs, and the launch is posted once they complete
+        cl_event event;
+        err = clEnqueueReadBuffer(*_queue, *countBuffer, CL_FALSE, 0, launch->counts.size()*sizeof(cl_uint),
+            launch->counts.data(), 1, launch->outputEvent.get(), &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueReadBuffer()", clErrToStr(err));
+        launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+    }
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        inputs[i]->consume(inputElems);
+    }
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        //take the buffer from the port, it is posted when the read completes
+        auto buff = outputs[i]->buffer();
+        buff.length = outputElems*outputs[i]->dtype().size();
+        outputs[i]->popElements(outputElems);
+        launch->outputs.push_back(buff);
+
+        //device resident outputs are consumed in place by the downstream kernel
+        if (_deviceResident[i]) continue;
+
+        //unified memory and SVM outputs are made readable by the host without a copy
+        cl_event event;
+        if (isClZeroCopyFromChunk(buff))
+        {
+            err = enqueueClZeroCopyReadback(*_queue, buff, *launch->outputEvent, &event);
+            if (err < 0) throw Pothos::Exception("OpenClKernel::work::enqueueClZeroCopyReadback()", clErrToStr(err));
+            launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+            continue;
+        }
+
+        //variable outputs read back their full capacity with the counts,
+        //and are trimmed on the host once both reads have completed
+        err = clEnqueueReadBuffer(*_queue, outputBuffs[i], CL_FALSE, 0,
+            buff.length, buff.as<void *>(), 1, launch->outputEvent.get(), &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::work::clEnqueueReadBuffer()", clErrToStr(err));
+        launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+        if (_profiler) _profiler->record(OpenClProfiler::DOWNLOAD, launch->events.back(), buff.length);
+    }
+    err = clFlush(*_queue);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::work::clFlush()", clErrToStr(err));
+    _launches.push_back(launch);
+    _labelLaunch = launch;
+
+    //without a readback, post the outputs now and let the
+    //downstream kernel wait on the output event on the device
+    const bool previousPosted = _launches.size() == 1 or _launches[_launches.size()-2]->posted;
+    if (launch->events.size() == numDeviceEvents and previousPosted) this->postLaunch(*launch);
+
+    //block on the oldest launches until the pipeline is within its depth
+    while (_launches.size() >= _pipelineDepth)
+    {
+        this->waitLaunch(*_launches.front());
+        this->retireLaunch();
+    }
+
+    //come back to produce the launches still in flight
+    if (not _launches.empty()) this->yield();
+}
+
+void OpenClKernel::workPackets(void)
+{
+    const auto &inputs = this->inputs();
+    const auto &outputs = this->outputs();
+    if (inputs.size() != 1) throw Pothos::Exception("OpenClKernel::workPackets()", "packet mode requires one input port");
+    auto inputPort = inputs[0];
+    const size_t inElemSize = inputPort->dtype().size();
+
+    //batch the available packets up to the maximum batch of elements,
+    //messages that are not packets keep their place in between the packets
+    std::vector<Pothos::Object> messages;
+    std::vector<Pothos::Packet> packets;
+    std::vector<cl_uint> offsetsAndLengths;
+    size_t totalElems = 0;
+    while (inputPort->hasMessage() and (_maxBatch == 0 or totalElems < _maxBatch or packets.empty()))
+    {
+        messages.push_back(inputPort->popMessage());
+        const auto &msg = messages.back();
+        if (msg.type() != typeid(Pothos::Packet)) continue;
+        const auto &packet = msg.extract<Pothos::Packet>();
+        if (packet.payload.length % inElemSize != 0) throw Pothos::Exception("OpenClKernel::workPackets()",
+            "packet length "+std::to_string(packet.payload.length)+" is not a multiple of the input type");
+        packets.push_back(packet);
+        totalElems += packet.payload.length/inElemSize;
+    }
+
+    //nothing to launch: empty packets and other messages are forwarded as they are,
+    //after the outputs of the launches in flight, then drain the oldest launch
+    if (totalElems == 0)
+    {
+        if (_launches.empty())
+        {
+            for (const auto &output : outputs) for (const auto &msg : messages) output->postMessage(msg);
+            return;
+        }
+        auto &pending = _launches.back()->messages;
+        pending.resize(outputs.size());
+        for (auto &outputMessages : pending) outputMessages.insert(outputMessages.end(), messages.begin(), messages.end());
+        this->waitLaunch(*_launches.front());
+        this->retireLaunch();
+        if (not _launches.empty()) this->yield();
+        return;
+    }
+
+    cl_int err = 0;
+    std::shared_ptr<Launch> launch(new Launch());
+    launch->posted = false;
+    launch->tuneGlobalSize = 0;
+    launch->tuneLocalSize = 0;
+    launch->tuneOtherItems = 1;
+    launch->tuneWorkItems = 0;
+    launch->primaryElems = 0;
+
+    //the packets are packed into one host staging buffer with a single upload,
+    //followed by the offsets and lengths of the packets in elements
+    const size_t numPackets = packets.size();
+    launch->hostStaging.emplace_back(totalElems*inElemSize);
+    offsetsAndLengths.resize(2*numPackets);
+    for (size_t p = 0, offset = 0; p < numPackets; p++)
+    {
+        const auto &payload = packets[p].payload;
+        std::memcpy(launch->hostStaging.back().data() + offset*inElemSize, payload.as<const void *>(), payload.length);
+        offsetsAndLengths[p] = offset;
+        offsetsAndLengths[numPackets+p] = payload.length/inElemSize;
+        offset += payload.length/inElemSize;
+    }
+    launch->hostStaging.emplace_back(reinterpret_cast<const char *>(offsetsAndLengths.data()),
+        reinterpret_cast<const char *>(offsetsAndLengths.data() + offsetsAndLengths.size()));
+
+    //each staging buffer is held by the launch before the next one is acquired
+    std::vector<cl_event> waitList;
+    const auto upload = [&](const void *data, const size_t numBytes)
+    {
+        auto staging = this->acquireStaging(_packetBuffers, numBytes);
+        launch->scratch.push_back(staging);
+        cl_event event;
+        err = clEnqueueWriteBuffer(*_queue, *staging, CL_FALSE, 0, numBytes, data, 0, nullptr, &event);
+        if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::clEnqueueWriteBuffer()", clErrToStr(err));
+        launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+        if (_profiler) _profiler->record(OpenClProfiler::UPLOAD, launch->events.back(), numBytes);
+        waitList.push_back(event);
+        return staging;
+    };
+    const auto *hostOffsets = reinterpret_cast<const cl_uint *>(launch->hostStaging.back().data());
+    const auto inBuff = upload(launch->hostStaging.front().data(), totalElems*inElemSize);
+    const auto offsetsBuff = upload(hostOffsets, numPackets*sizeof(cl_uint));
+    const auto lengthsBuff = upload(hostOffsets+numPackets, numPackets*sizeof(cl_uint));
+
+    size_t argNo = 0;
+    err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), inBuff.get());
+    if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::clSetKernelArg()", clErrToStr(err));
+    std::vector<std::shared_ptr<cl_mem>> outBuffs;
+    const size_t totalOutElems = scaleElems(totalElems, _productionFactor);
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        outBuffs.push_back(this->acquireStaging(_packetBuffers, std::max<size_t>(totalOutElems*outputs[i]->dtype().size(), 1)));
+        launch->scratch.push_back(outBuffs.back());
+        err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), outBuffs.back().get());
+        if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::clSetKernelArg()", clErrToStr(err));
+    }
+    const cl_uint numPacketsArg = numPackets;
+    err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), offsetsBuff.get());
+    if (err == 0) err = clSetKernelArg(*_kernel, argNo++, sizeof(cl_mem), lengthsBuff.get());
+    if (err == 0) err = clSetKernelArg(*_kernel, argNo++, sizeof(numPacketsArg), &numPacketsArg);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::clSetKernelArg()", clErrToStr(err));
+    this->bindKernelArgs(*_kernel, argNo, 0);
+
+    /* Enqueue kernel over the whole batch */
+    const size_t localSize = _localShape.front();
+    size_t globalSize = std::max<size_t>(size_t(totalElems*_globalFactor + 0.5), 1);
+    if (localSize != 0) globalSize = ((globalSize+localSize-1)/localSize)*localSize;
+    cl_event kernelEvent;
+    err = clEnqueueNDRangeKernel(*_queue, *_kernel, 1, nullptr, &globalSize, (localSize == 0)?nullptr:&localSize,
+        waitList.size(), waitList.data(), &kernelEvent);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::enqueueKernel()", clErrToStr(err));
+    launch->kernelEvent.reset(new cl_event(kernelEvent), clReleaseEventPtr);
+    launch->outputEvent = launch->kernelEvent;
+    launch->events.push_back(launch->kernelEvent);
+    if (_profiler) _profiler->record(OpenClProfiler::KERNEL, launch->kernelEvent);
+
+    /* Read back each output, the output packets are slices of one buffer */
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const auto &dtype = outputs[i]->dtype();
+        Pothos::BufferChunk buff(dtype, totalOutElems);
+        if (totalOutElems != 0)
+        {
+            cl_event event;
+            err = clEnqueueReadBuffer(*_queue, *outBuffs[i], CL_FALSE, 0, buff.length, buff.as<void *>(), 1, launch->outputEvent.get(), &event);
+            if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::clEnqueueReadBuffer()", clErrToStr(err));
+            launch->events.emplace_back(new cl_event(event), clReleaseEventPtr);
+            if (_profiler) _profiler->record(OpenClProfiler::DOWNLOAD, launch->events.back(), buff.length);
+        }
+        launch->messages.emplace_back();
+        for (size_t m = 0, p = 0; m < messages.size(); m++)
+        {
+            if (messages[m].type() != typeid(Pothos::Packet))
+            {
+                launch->messages.back().push_back(messages[m]);
+                continue;
+            }
+            auto packet = packets[p];
+            const size_t first = scaleElems(offsetsAndLengths[p], _productionFactor);
+            const size_t last = (p+1 == numPackets)?totalOutElems:scaleElems(offsetsAndLengths[p+1], _productionFactor);
+            packet.payload = buff;
+            packet.payload.address += first*dtype.size();
+            packet.payload.length = (last-first)*dtype.size();
+            for (auto &label : packet.labels) label = label.toAdjusted(_productionFactor, 1.0);
+            launch->messages.back().push_back(Pothos::Object(packet));
+            p++;
+        }
+    }
+    err = clFlush(*_queue);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::workPackets::clFlush()", clErrToStr(err));
+    _launches.push_back(launch);
+
+    //block on the oldest launches until the pipeline is within its depth
+    while (_launches.size() >= _pipelineDepth)
+    {
+        this->waitLaunch(*_launches.front());
+        this->retireLaunch();
+    }
+
+    //come back for more packets and to produce the launches still in flight
+    if (not _launches.empty() or inputPort->hasMessage()) this->yield();
+}
+
+void OpenClKernel::activate(void)
+{
+    //wait for the first build, so that build errors are reported when the topology is committed
+    this->applyProgramBuild(not _kernel);
+    if (not _kernel) throw Pothos::Exception("OpenClKernel::activate()", "no kernel source specified");
+    if (not _queue) this->updateQueue();
+}
+
+void OpenClKernel::deactivate(void)
+{
+    //the topology is done with this block, discard launches in flight
+    for (const auto &launch : _launches) this->waitLaunch(*launch);
+    _launches.clear();
+    _labelLaunch.reset();
+    _batchWaiting = false;
+
+    //the next activation starts with a zero history
+    for (auto &history : _histories)
+    {
+        history.tail.reset();
+        history.tailEvent.reset();
+    }
+}
+
+void OpenClKernel::propagateLabels(const Pothos::InputPort *port)
+{
+    //labels consumed by a launch still in flight are posted with its outputs
+    const auto launch = _labelLaunch;
+    for (const auto &label : port->labels())
+    {
+        const auto adjusted = label.toAdjusted(_productionFactor, 1.0);
+        if (launch and not launch->posted)
+        {
+            launch->labels.push_back(adjusted);
+            continue;
+        }
+        const auto &outputs = this->outputs();
+        for (size_t i = 0; i < outputs.size(); i++)
+        {
+            auto posted = adjusted;
+            if (launch) posted.index += launch->postOffsets[i];
+            outputs[i]->postLabel(posted);
+        }
+    }
+}
+
+static Pothos::BlockRegistry registerOpenClKernel(
+    "/blocks/opencl_kernel", &OpenClKernel::make);
+
+/***********************************************************************
+ * |PothosDoc OpenCL Kernel Chain
+ *
+ * The OpenCL Kernel Chain block runs a list of kernels from one program
+ * in order, within a single block and a single call to work().
+ * Intermediate results stay in device scratch buffers owned by the block,
+ * which saves the scheduling, buffer management, and readback between
+ * separate OpenCL Kernel blocks. Every stage runs over the same range.
+ *
+ * The first kernel is bound like the OpenCL Kernel block, except that its
+ * only output is the first intermediate buffer. Each following kernel takes
+ * (in, out) where in is the previous intermediate buffer, and the last kernel
+ * takes (in, outputs...) with the output ports of the block.
+ * The extents of multi-dimensional ranges follow the buffers of every stage,
+ * and the counts of variable output mode follow those of the last stage.
+ * Additional arguments are bound to the first kernel.
+ * Kernel chains are not applied in packet mode.
+ *
+ * |category /Kernels
+ * |category /OpenCL
+ * |keywords kernel jit opencl chain fusion
+ *
+ * |param deviceId[Device ID] A markup to specify OpenCL platform and device.
+ * See the OpenCL Kernel block for the format.
+ * |default "0:0"
+ *
+ * |param inputTypes[Input Types] An array of input port sizes.
+ * |unit bytes
+ * |default ["float32"]
+ *
+ * |param outputTypes[Output Types] An array of output port sizes.
+ * |unit bytes
+ * |default ["float32"]
+ *
+ * |param kernelNames[Kernel Names] The names of the kernels in the source, in order.
+ * |default []
+ *
+ * |param kernelSource[Kernel Source] Source code for the OpenCL kernels,
+ * or a path to a .cl file containing the cl source code.
+ * |default ""
+ * |widget FileEntry(mode=open)
+ *
+ * |param intermediateTypes[Intermediate Types] The data type written by each stage but the last.
+ * Each intermediate buffer holds one element of its type per output element.
+ * Missing entries default to the type of the first output port.
+ * |default []
+ * |preview valid
+ *
+ * |param buildOptions[Build Options] Options passed to the OpenCL compiler.
+ * |default ""
+ * |widget StringEntry()
+ * |preview valid
+ *
+ * |param defines[Defines] A map of named compile-time constants for the program.
+ * |default {}
+ * |preview valid
+ *
+ * |param localSize[Local Size] The number of work units/resources to allocate.
+ * A local size of 0 automatically tunes the local size of the first kernel.
+ * |default 2
+ * |option [Auto] 0
+ * |widget ComboBox(editable=true)
+ *
+ * |param globalFactor[Global Factor] This factor controls the global size.
+ * Global size = number of input elements * global factor.
+ * |default 1.0
+ *
+ * |param productionFactor[Production Factor] This factor controls the elements produced.
+ * For each call to work, elements produced = number of input elements * production factor.
+ * |default 1.0
+ *
+ * |param pipelineDepth[Pipeline Depth] The maximum number of chain launches in flight.
+ * |default 1
+ * |preview valid
+ *
+ * |factory /blocks/opencl_kernel_chain(deviceId, inputTypes, outputTypes)
+ * |setter setIntermediateTypes(intermediateTypes)
+ * |setter setBuildOptions(buildOptions)
+ * |setter setDefines(defines)
+ * |setter setKernelChain(kernelNames, kernelSource)
+ * |setter setLocalSize(localSize)
+ * |setter setGlobalFactor(globalFactor)
+ * |setter setProductionFactor(productionFactor)
+ * |setter setPipelineDepth(pipelineDepth)
+ **********************************************************************/
+static Pothos::BlockRegistry registerOpenClKernelChain(
+    "/blocks/opencl_kernel_chain", &OpenClKernel::make);
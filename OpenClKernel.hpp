@@ -2,8 +2,17 @@
 // SPDX-License-Identifier: BSL-1.0
 
 #pragma once
-#include <Pothos/Framework/BufferManager.hpp>
+#include <Pothos/Framework.hpp>
 #include <memory>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <map>
 
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
@@ -18,9 +27,158 @@
 //! cache for contexts so we can get the same context per device
 std::shared_ptr<cl_context> lookupContextCache(cl_device_id device);
 
+//! create a command queue owned by the caller
+std::shared_ptr<cl_command_queue> makeCommandQueue(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    cl_command_queue_properties properties);
+
+//! cache for command queues so blocks on a device can share a queue
+std::shared_ptr<cl_command_queue> lookupQueueCache(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    cl_command_queue_properties properties);
+
 //! error code number to string
 const char *clErrToStr(cl_int err);
 
+//! create and build a program for the device, using the on-disk binary cache
+std::shared_ptr<cl_program> buildOpenClProgram(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const std::string &source,
+    const std::string &options);
+
+//! cache for built programs so blocks with the same source share a program
+std::shared_ptr<cl_program> lookupProgramCache(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const std::string &source,
+    const std::string &options);
+
+//! remove all entries from the on-disk program binary cache
+void clearProgramBinaryCache(void);
+
+//! the OpenCL C name of a scalar type, or the element type of a complex type
+std::string clScalarTypeName(const Pothos::DType &dtype);
+
+//! create a kernel that converts (in, out, offset, scale) between port and compute types
+std::shared_ptr<cl_kernel> makeOpenClPortConvertKernel(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const Pothos::DType &inputType,
+    const Pothos::DType &outputType);
+
+/***********************************************************************
+ * Tune the local work-group size of a kernel by timing candidates
+ * on live launches, keyed per global size (power of two buckets).
+ * Tuned sizes are persisted so later runs start at the tuned value.
+ **********************************************************************/
+class OpenClLocalSizeTuner
+{
+public:
+    //! The key identifies the device and kernel for persistent storage
+    OpenClLocalSizeTuner(cl_kernel kernel, cl_device_id device, const std::string &key);
+
+    //! The local size to use for the next launch of this global size,
+    //! other items is the product of the local sizes of the other dimensions
+    size_t nextLocalSize(const size_t globalSize, const size_t otherItems);
+
+    //! Record the profiled kernel event of a completed launch,
+    //! the global size and other items pick the bucket, work items is the size enqueued
+    void record(const size_t globalSize, const size_t otherItems, const size_t localSize, const size_t workItems, cl_event event);
+
+private:
+    struct Trial
+    {
+        Trial(void): count(0), nsPerElem(0.0){}
+        size_t count;
+        double nsPerElem;
+    };
+
+    struct Bucket
+    {
+        size_t tuned;
+        std::map<size_t, Trial> trials;
+    };
+
+    static size_t bucketOf(const size_t globalSize);
+    std::string bucketKey(const size_t globalSize, const size_t otherItems) const;
+    Bucket &getBucket(const size_t globalSize, const size_t otherItems);
+
+    const std::string _key;
+    size_t _maxSize;
+    std::vector<size_t> _candidates;
+    std::map<std::pair<size_t, size_t>, Bucket> _buckets;
+};
+
+/***********************************************************************
+ * Collect the profiling information of kernel and transfer events.
+ * Events are recorded when enqueued and their timing is collected
+ * once they complete, into rolling statistics reported as JSON.
+ * The command queue must have CL_QUEUE_PROFILING_ENABLE.
+ * A block and its buffer managers share one profiler for their lifetime,
+ * so profiling can be enabled and disabled while the topology runs.
+ **********************************************************************/
+class OpenClProfiler
+{
+public:
+    enum Kind {KERNEL, UPLOAD, DOWNLOAD};
+
+    OpenClProfiler(void);
+
+    //! Enable or disable recording, enabling starts over with empty statistics
+    void setEnabled(const bool enabled);
+
+    bool isEnabled(void) const
+    {
+        return _enabled;
+    }
+
+    //! Record an enqueued command of the given kind and transfer size, when enabled
+    void record(const Kind kind, const std::shared_ptr<cl_event> &event, const size_t numBytes = 0);
+
+    //! Rolling statistics of the completed commands as a JSON string
+    std::string toJSON(void);
+
+private:
+    struct Pending
+    {
+        Kind kind;
+        std::shared_ptr<cl_event> event;
+        size_t numBytes;
+    };
+
+    struct Stats
+    {
+        Stats(void);
+        std::deque<double> durations;
+        unsigned long long totalBytes;
+        unsigned long long totalCount;
+        double totalTime;
+    };
+
+    void collect(void);
+
+    std::atomic<bool> _enabled;
+    std::mutex _mutex;
+    std::deque<Pending> _pending;
+    Stats _stats[3];
+    std::deque<double> _queueWaits;
+    std::deque<cl_ulong> _launchTimes;
+};
+
+/***********************************************************************
+ * Idle buffer arenas of one context and queue, kept for reuse
+ * when the topology is re-committed, see OpenClBufferManager.cpp
+ **********************************************************************/
+class OpenClArenaPool;
+
+//! The arena pool of a context and queue, shared by the blocks that use them
+std::shared_ptr<OpenClArenaPool> lookupOpenClArenaPool(
+    const std::shared_ptr<cl_context> &context,
+    const std::shared_ptr<cl_command_queue> &queue);
+
 /***********************************************************************
  * arguments required to create a custom cl buffer manager
  **********************************************************************/
@@ -29,15 +187,55 @@ struct OpenClBufferContainerArgs
     cl_mem_flags mem_flags;
     cl_map_flags map_flags;
     std::shared_ptr<cl_context> context;
+    cl_device_id device;
     std::shared_ptr<cl_command_queue> queue;
+    std::shared_ptr<OpenClProfiler> profiler;
+    std::shared_ptr<OpenClArenaPool> arenaPool;
 };
 
 //! Factory function for creating a cl buffer manager
 Pothos::BufferManager::Sptr makeOpenClBufferManager(const OpenClBufferContainerArgs &);
 
+//! Factory function for creating a circular cl buffer manager
+Pothos::BufferManager::Sptr makeOpenClCircularBufferManager(const OpenClBufferContainerArgs &);
+
+//! Factory function for creating a host-facing buffer manager (zero copy on unified memory devices)
+Pothos::BufferManager::Sptr makeOpenClUnifiedBufferManager(const OpenClBufferContainerArgs &);
+
+//! Factory function for creating a shared virtual memory buffer manager (unified or discrete without SVM support)
+Pothos::BufferManager::Sptr makeOpenClSvmBufferManager(const OpenClBufferContainerArgs &);
+
 //! Extract the cl_mem object from the managed buffer
 cl_mem &getClBufferFromManaged(const Pothos::ManagedBuffer &buff);
 
+//! The event that must complete before the managed buffer's contents are valid
+std::shared_ptr<cl_event> &getClEventFromManaged(const Pothos::ManagedBuffer &buff);
+
+//! The byte offset of the chunk in its cl_mem object (modulo the ring size of circular buffers)
+size_t getClOffsetFromChunk(const Pothos::BufferChunk &chunk);
+
+//! True when the chunk's host memory holds its contents, false for device resident buffers
+bool isClHostValidFromChunk(const Pothos::BufferChunk &chunk);
+
+//! True when the chunk's buffer is mapped by the host instead of copied (unified memory or SVM)
+bool isClZeroCopyFromChunk(const Pothos::BufferChunk &chunk);
+
+//! The shared virtual memory pointer of the chunk, or null for cl_mem buffers
+void *getClSvmPointerFromChunk(const Pothos::BufferChunk &chunk);
+
+//! Bind a shared virtual memory pointer to a kernel argument
+cl_int setClKernelArgSvm(cl_kernel kernel, const cl_uint index, const void *svmPtr);
+
+//! Enqueue the command that makes a zero copy output chunk readable by the host after waitEvent
+cl_int enqueueClZeroCopyReadback(cl_command_queue queue, const Pothos::BufferChunk &chunk, cl_event waitEvent, cl_event *event);
+
+//! Make the first numBytes of a circular buffer chunk contiguous on the device when they wrap
+//! past the end of the ring, the copy waits on event and replaces it, no-op otherwise
+cl_int enqueueClRingWrap(cl_command_queue queue, const Pothos::BufferChunk &chunk, const size_t numBytes, std::shared_ptr<cl_event> &event);
+
+//! Record the kernel that read a wrapped window of a circular buffer chunk, the next wrap waits on it
+void setClRingWrapReader(const Pothos::BufferChunk &chunk, const std::shared_ptr<cl_event> &event);
+
 /***********************************************************************
  * smart pointer deleters for managing cl objects
  **********************************************************************/
@@ -60,3 +258,528 @@ inline void clReleaseKernelPtr(cl_kernel *p)
 {
     clReleaseKernel(*p);
 }
+
+inline void clReleaseEventPtr(cl_event *p)
+{
+    clReleaseEvent(*p);
+}
+
+inline void clReleaseMemObjectPtr(cl_mem *p)
+{
+    clReleaseMemObject(*p);
+}
+
+/***********************************************************************
+ * The OpenCL kernel block: see the block documentation in OpenClKernel.cpp.
+ * Blocks with built-in kernels derive from it and configure the source,
+ * arguments, and factors in their constructors.
+ **********************************************************************/
+class OpenClKernel : public Pothos::Block
+{
+public:
+    static Pothos::Block *make(const std::string &deviceId, const std::vector<std::string> &inputTypes, const std::vector<std::string> &outputTypes)
+    {
+        return new OpenClKernel(deviceId, inputTypes, outputTypes);
+    }
+
+    OpenClKernel(const std::string &deviceId, const std::vector<std::string> &inputTypes, const std::vector<std::string> &outputTypes);
+
+    ~OpenClKernel(void)
+    {
+        //the build threads hold references to the contexts
+        if (_pendingBuild.valid()) _pendingBuild.wait();
+        _supersededBuilds.clear();
+
+        //reset in order of creation
+        _launches.clear();
+        _secondaries.clear();
+        _chainKernels.clear();
+        _kernel.reset();
+        _arenaPool.reset();
+        _queue.reset();
+        _program.reset();
+        _context.reset();
+    }
+
+    void setSource(const std::string &name, const std::string &source);
+
+    void setKernelChain(const std::vector<std::string> &names, const std::string &source);
+
+    std::vector<std::string> getKernelChain(void) const
+    {
+        std::vector<std::string> names(1, _kernelName);
+        names.insert(names.end(), _chainNames.begin(), _chainNames.end());
+        return names;
+    }
+
+    void setIntermediateTypes(const std::vector<std::string> &types);
+
+    void setBuildOptions(const std::string &options);
+
+    std::string getBuildOptions(void) const
+    {
+        return _buildOptions;
+    }
+
+    void setDefines(const Pothos::ObjectKwargs &defines);
+
+    void setScalarArg(const size_t index, const std::string &dtype, const double value);
+
+    void setConstantArg(const size_t index, const std::string &dtype, const std::vector<double> &values);
+
+    void setLocalArg(const size_t index, const size_t numBytes);
+
+    void setScalarArgs(const Pothos::ObjectKwargs &args);
+
+    void setLocalArgs(const Pothos::ObjectKwargs &args);
+
+    void setHistory(const size_t index, const size_t numElems);
+
+    size_t getHistory(const size_t index) const
+    {
+        if (index >= _histories.size()) throw Pothos::RangeException("OpenClKernel::getHistory()", "no input "+std::to_string(index));
+        return _histories[index].numElems;
+    }
+
+    void setHistories(const std::vector<size_t> &histories);
+
+    void setInputComputeType(const size_t index, const std::string &dtype, const double scale);
+
+    void setOutputComputeType(const size_t index, const std::string &dtype, const double scale);
+
+    void setInputComputeTypes(const Pothos::ObjectKwargs &types);
+
+    void setOutputComputeTypes(const Pothos::ObjectKwargs &types);
+
+    void setLocalSize(const size_t size)
+    {
+        _localShape.assign(1, size);
+    }
+
+    size_t getLocalSize(void) const
+    {
+        return _localShape.front();
+    }
+
+    void setLocalShape(const std::vector<size_t> &shape)
+    {
+        if (shape.size() > 3) throw Pothos::Exception("OpenClKernel::setLocalShape()", "more than 3 dimensions");
+        for (size_t d = 1; d < shape.size(); d++)
+        {
+            if (shape[d] == 0) throw Pothos::Exception("OpenClKernel::setLocalShape()", "only the first dimension can be tuned");
+        }
+        if (not shape.empty()) _localShape = shape;
+    }
+
+    std::vector<size_t> getLocalShape(void) const
+    {
+        return _localShape;
+    }
+
+    void setFrameShape(const std::vector<size_t> &shape)
+    {
+        if (shape.size() > 2) throw Pothos::Exception("OpenClKernel::setFrameShape()", "more than 2 inner dimensions");
+        for (const auto dim : shape)
+        {
+            if (dim == 0) throw Pothos::Exception("OpenClKernel::setFrameShape()", "dimensions must be non-zero");
+        }
+        _frameShape = shape;
+    }
+
+    std::vector<size_t> getFrameShape(void) const
+    {
+        return _frameShape;
+    }
+
+    void setGlobalFactor(const double factor)
+    {
+        _globalFactor = factor;
+    }
+
+    double getGlobalFactor(void) const
+    {
+        return _globalFactor;
+    }
+
+    void setProductionFactor(const double factor)
+    {
+        _productionFactor = factor;
+    }
+
+    double getProductionFactor(void) const
+    {
+        return _productionFactor;
+    }
+
+    void setMinBatch(const size_t numElems)
+    {
+        _minBatch = numElems;
+    }
+
+    size_t getMinBatch(void) const
+    {
+        return _minBatch;
+    }
+
+    void setMaxBatch(const size_t numElems)
+    {
+        _maxBatch = numElems;
+    }
+
+    size_t getMaxBatch(void) const
+    {
+        return _maxBatch;
+    }
+
+    void setBatchTimeout(const double timeout)
+    {
+        if (timeout < 0.0) throw Pothos::Exception("OpenClKernel::setBatchTimeout()", "timeout must not be negative");
+        _batchTimeout = timeout;
+    }
+
+    double getBatchTimeout(void) const
+    {
+        return _batchTimeout;
+    }
+
+    void setPacketMode(const bool enabled)
+    {
+        _packetMode = enabled;
+    }
+
+    bool getPacketMode(void) const
+    {
+        return _packetMode;
+    }
+
+    void setVariableOutput(const bool enabled)
+    {
+        _variableOutput = enabled;
+    }
+
+    bool getVariableOutput(void) const
+    {
+        return _variableOutput;
+    }
+
+    void setPipelineDepth(const size_t depth)
+    {
+        if (depth == 0) throw Pothos::Exception("OpenClKernel::setPipelineDepth()", "depth must be at least 1");
+        _pipelineDepth = depth;
+    }
+
+    size_t getPipelineDepth(void) const
+    {
+        return _pipelineDepth;
+    }
+
+    void setBufferSize(const size_t numBytes)
+    {
+        _bufferSize = numBytes;
+    }
+
+    size_t getBufferSize(void) const
+    {
+        return _bufferSize;
+    }
+
+    void setBufferMode(const std::string &mode)
+    {
+        if (mode != "DISCRETE" and mode != "CIRCULAR" and mode != "SVM")
+        {
+            throw Pothos::Exception("OpenClKernel::setBufferMode("+mode+")", "unknown buffer mode");
+        }
+        _bufferMode = mode;
+    }
+
+    std::string getBufferMode(void) const
+    {
+        return _bufferMode;
+    }
+
+    void setQueueMode(const std::string &mode);
+
+    std::string getQueueMode(void) const
+    {
+        return _queueMode;
+    }
+
+    void setProfilingEnabled(const bool enabled)
+    {
+        _profiler->setEnabled(enabled);
+    }
+
+    bool getProfilingEnabled(void) const
+    {
+        return _profiler->isEnabled();
+    }
+
+    std::string getProfilingStats(void)
+    {
+        if (not _profiler->isEnabled()) throw Pothos::Exception("OpenClKernel::getProfilingStats()", "profiling is not enabled");
+        return _profiler->toJSON();
+    }
+
+    Pothos::BufferManager::Sptr getInputBufferManager(const std::string &, const std::string &domain)
+    {
+        if (domain.empty())
+        {
+            return this->makeBufferManager(CL_MEM_READ_ONLY, CL_MAP_WRITE, _bufferMode);
+        }
+        if (domain == _myDomain)
+        {
+            return Pothos::BufferManager::Sptr();
+        }
+        throw Pothos::PortDomainError();
+    }
+
+    Pothos::BufferManager::Sptr getOutputBufferManager(const std::string &name, const std::string &domain)
+    {
+        //all consumers are kernels on this device: the output stays device resident
+        //and the downstream kernel reads the same cl_mem without a host readback
+        if (domain == _myDomain)
+        {
+            _deviceResident[this->output(name)->index()] = true;
+            return this->makeBufferManager(CL_MEM_READ_WRITE, 0, "RESIDENT");
+        }
+        if (domain.empty())
+        {
+            _deviceResident[this->output(name)->index()] = false;
+            return this->makeBufferManager(CL_MEM_WRITE_ONLY, CL_MAP_READ, (_bufferMode == "SVM")?"SVM":"DISCRETE");
+        }
+        throw Pothos::PortDomainError();
+    }
+
+    void work(void);
+
+    void activate(void);
+
+    void deactivate(void);
+
+    void propagateLabels(const Pothos::InputPort *port);
+
+protected:
+    //! The primary device, for blocks that size their kernels to its limits
+    cl_device_id getDevice(void) const
+    {
+        return _device;
+    }
+
+    /*!
+     * Set the defines along with the launch state coupled to them, such as constant
+     * arguments, history, or shapes. The launch state is applied when the kernel built
+     * with these defines is swapped in, so no launch pairs the previous kernel with
+     * the new launch state, and the caller is not stalled by the build.
+     * The launch state function must capture the values it sets by copy.
+     */
+    void setDefinesWithLaunchState(const Pothos::ObjectKwargs &defines, const std::function<void(void)> &launchState);
+
+    /*!
+     * With a global factor below 1.0, launch a last partial work-item for the
+     * remaining elements instead of leaving them in the input until a whole
+     * work-item is available. The kernel must bound the accesses of that
+     * work-item by the element count, passed to prepareLaunch() as an argument.
+     */
+    void setPartialWorkItems(const bool enabled)
+    {
+        _partialWorkItems = enabled;
+    }
+
+    /*!
+     * Called before each launch is enqueued with the number of input elements it consumes.
+     * Blocks built on this class update per-launch arguments here, such as a running phase.
+     */
+    virtual void prepareLaunch(const size_t)
+    {
+        return;
+    }
+
+private:
+    /*!
+     * The share of a launch that runs on an additional device.
+     * The start and end events are the first and last commands
+     * on the queue of that device, and bound its profiled time.
+     */
+    struct SecondaryLaunch
+    {
+        size_t deviceIndex;
+        size_t first;
+        size_t numElems;
+        std::vector<size_t> outputStaging; //indexes into the launch's host staging
+        std::shared_ptr<cl_event> startEvent;
+        std::shared_ptr<cl_event> endEvent;
+        std::shared_ptr<cl_event> doneEvent; //completes with the end event, in the primary context
+    };
+
+    /*!
+     * A kernel launch that has been enqueued but has not completed.
+     * The input chunks keep the device memory from being recycled upstream,
+     * and the output chunks are posted downstream once the readback completes,
+     * or right away with the kernel event when no readback is required.
+     */
+    struct Launch
+    {
+        std::vector<Pothos::BufferChunk> inputs;
+        std::vector<Pothos::BufferChunk> outputs;
+        std::vector<std::shared_ptr<cl_mem>> scratch;
+        std::vector<std::vector<char>> hostStaging;
+        std::vector<cl_uint> counts; //elements produced per output in variable output mode
+        std::vector<std::vector<Pothos::Object>> messages; //output packets and pass-through messages per output port in packet mode
+        std::shared_ptr<cl_event> kernelEvent;
+        std::shared_ptr<cl_event> outputEvent;
+        size_t primaryElems;
+        std::vector<SecondaryLaunch> secondaryLaunches;
+        std::vector<std::shared_ptr<cl_event>> events;
+        std::vector<Pothos::Label> labels;
+        std::vector<size_t> postOffsets;
+        bool posted;
+        size_t tuneGlobalSize;
+        size_t tuneLocalSize;
+        size_t tuneOtherItems;
+        size_t tuneWorkItems; //global size actually enqueued on the primary device
+    };
+
+    /*!
+     * An additional kernel argument bound by index:
+     * a scalar value, a device resident constant buffer, or __local memory.
+     */
+    struct KernelArg
+    {
+        std::vector<char> value;
+        std::vector<std::shared_ptr<cl_mem>> memobjs; //per device
+        size_t localSize;
+    };
+
+    /*!
+     * An additional device that runs a share of each launch.
+     * It has its own queue and kernel, and port buffers that are
+     * filled from and read back through host memory without blocking,
+     * the commands on different contexts are chained with user events.
+     */
+    struct SecondaryDevice
+    {
+        cl_device_id device;
+        std::shared_ptr<cl_context> context;
+        std::shared_ptr<cl_command_queue> queue;
+        std::shared_ptr<cl_program> program;
+        std::shared_ptr<cl_kernel> kernel;
+        std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> inputs;
+        std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> outputs;
+    };
+
+    /*!
+     * The device resident history of an input port.
+     * Each launch copies the history and the new elements into a staging buffer,
+     * and the tail of that staging buffer is the history of the next launch.
+     */
+    struct InputHistory
+    {
+        size_t numElems;
+        std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> buffers;
+        std::shared_ptr<cl_mem> tail;
+        size_t tailOffset;
+        std::shared_ptr<cl_event> tailEvent;
+    };
+
+    /*!
+     * The conversion of a port between its wire type and the kernel's compute type.
+     * Each launch converts into or out of a staging buffer of the compute type.
+     */
+    struct PortConversion
+    {
+        size_t computeSize; //bytes per element, 0 without a conversion
+        double scale;
+        std::shared_ptr<cl_kernel> kernel;
+        std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> buffers;
+    };
+
+    std::shared_ptr<cl_mem> acquireStaging(std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> &buffers, const size_t numBytes);
+    cl_event enqueuePortConvert(const PortConversion &conversion, cl_mem in, const void *inSvm, const size_t inOffset,
+        cl_mem out, const void *outSvm, const size_t numScalars, const std::vector<cl_event> &waitList);
+    void stageHistory(const size_t index, Launch &launch, const size_t numElems,
+        cl_mem &buff, size_t &offset, const std::shared_ptr<cl_event> &inputEvent, std::vector<cl_event> &waitList);
+    void bindKernelArgs(cl_kernel kernel, const size_t firstIndex, const size_t deviceIndex);
+    std::vector<size_t> splitElements(const size_t numElems, const size_t localSize);
+    void updateRate(const size_t deviceIndex, const double rate);
+    void enqueueSecondary(SecondaryDevice &secondary, const size_t deviceIndex, Launch &launch, const size_t first, const size_t numElems,
+        const std::vector<cl_mem> &inputBuffs, const std::vector<size_t> &inputOffsets, const std::vector<cl_event> &waitList);
+    void finishSecondary(Launch &launch, const SecondaryLaunch &share, const std::vector<cl_mem> &outputBuffs);
+    void workPackets(void);
+    bool isLaunchComplete(const Launch &launch);
+    void waitLaunch(const Launch &launch);
+    void postLaunch(Launch &launch);
+    void retireLaunch(void);
+    void updateQueue(void);
+    /*!
+     * The programs built in the background for a new source, options, or defines,
+     * and the kernel names to create from them once the build completes.
+     */
+    struct ProgramBuild
+    {
+        std::string kernelName;
+        std::vector<std::string> chainNames;
+        std::string source;
+        std::string options;
+        std::shared_ptr<cl_program> program;
+        std::vector<std::shared_ptr<cl_program>> secondaryPrograms;
+        std::function<void(void)> launchState; //applied when the kernels are swapped in
+    };
+
+    void updateKernel(void);
+    void applyProgramBuild(const bool wait);
+    void updateChainTypes(void);
+    Pothos::BufferManager::Sptr makeBufferManager(const cl_mem_flags memFlags, const cl_map_flags mapFlags, const std::string &mode);
+
+    std::string _myDomain;
+    cl_platform_id _platform;
+    cl_device_id _device;
+    std::shared_ptr<cl_context> _context;
+    std::shared_ptr<cl_program> _program;
+    std::shared_ptr<cl_kernel> _kernel;
+    std::future<ProgramBuild> _pendingBuild;
+    std::vector<std::future<ProgramBuild>> _supersededBuilds; //replaced while building, released once ready
+    std::function<void(void)> _launchState; //coupled to the defines, applied with the next build
+    std::shared_ptr<cl_command_queue> _queue;
+    std::shared_ptr<OpenClArenaPool> _arenaPool;
+    std::string _kernelName;
+    std::vector<std::string> _chainNames; //stages after the first kernel
+    std::vector<std::shared_ptr<cl_kernel>> _chainKernels;
+    std::vector<std::string> _intermediateTypeNames;
+    std::vector<Pothos::DType> _chainTypes; //the type written by each stage but the last, per chain kernel
+    std::vector<std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>>> _chainBuffers;
+    std::string _kernelSource;
+    std::string _buildOptions;
+    std::map<std::string, std::string> _defines;
+    std::map<size_t, KernelArg> _kernelArgs;
+    std::string _tunerKey;
+    std::shared_ptr<OpenClLocalSizeTuner> _tuner;
+    std::shared_ptr<OpenClProfiler> _profiler;
+    std::string _queueMode;
+    std::string _bufferMode;
+    std::vector<size_t> _localShape;
+    std::vector<size_t> _frameShape;
+    double _globalFactor;
+    bool _partialWorkItems;
+    double _productionFactor;
+    size_t _pipelineDepth;
+    size_t _bufferSize;
+    size_t _minBatch;
+    size_t _maxBatch;
+    double _batchTimeout;
+    bool _batchWaiting;
+    bool _variableOutput;
+    bool _packetMode;
+    std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> _packetBuffers;
+    std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> _countBuffers;
+    std::vector<std::pair<size_t, std::shared_ptr<cl_mem>>> _scratchBuffers;
+    std::chrono::high_resolution_clock::time_point _batchWaitStart;
+    std::deque<std::shared_ptr<Launch>> _launches;
+    std::shared_ptr<Launch> _labelLaunch;
+    std::vector<size_t> _postedElems;
+    std::vector<PortConversion> _inputConversions;
+    std::vector<PortConversion> _outputConversions;
+    std::vector<bool> _deviceResident;
+    std::vector<InputHistory> _histories;
+    std::vector<SecondaryDevice> _secondaries;
+    std::vector<double> _deviceRates;
+};
@@ -0,0 +1,201 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include "OpenClKernel.hpp"
+#include <Pothos/System.hpp>
+#include <Pothos/Exception.hpp>
+#include <Poco/Exception.h>
+#include <Poco/Path.h>
+#include <Poco/File.h>
+#include <Poco/Process.h>
+#include <iostream>
+#include <fstream>
+#include <cstdio> //rename
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <map>
+
+#include <json.hpp>
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Persistent storage of tuned local sizes,
+ * so later runs start with the tuned value
+ **********************************************************************/
+static const size_t NUM_TRIALS_PER_CANDIDATE = 8;
+
+static std::mutex &getTunedMutex(void)
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static Poco::Path getTunedPath(void)
+{
+    Poco::Path path(Pothos::System::getUserDataPath());
+    path.makeDirectory();
+    path.setFileName("OpenClLocalSizes.json");
+    return path;
+}
+
+static json &getTunedCache(void)
+{
+    static json tunedCache;
+    static bool loaded = false;
+    if (loaded) return tunedCache;
+    loaded = true;
+    try
+    {
+        std::ifstream file(getTunedPath().toString());
+        if (file.good()) tunedCache = json::parse(file);
+    }
+    catch (const std::exception &ex)
+    {
+        std::cerr << "OpenCL local size cache: " << ex.what() << std::endl;
+    }
+    if (not tunedCache.is_object()) tunedCache = json::object();
+    return tunedCache;
+}
+
+static bool lookupTunedLocalSize(const std::string &key, size_t &localSize)
+{
+    std::lock_guard<std::mutex> lock(getTunedMutex());
+    auto &tunedCache = getTunedCache();
+    auto it = tunedCache.find(key);
+    if (it == tunedCache.end() or not it->is_number_unsigned()) return false;
+    localSize = it->get<size_t>();
+    return true;
+}
+
+static void storeTunedLocalSize(const std::string &key, const size_t localSize)
+{
+    std::lock_guard<std::mutex> lock(getTunedMutex());
+    auto &tunedCache = getTunedCache();
+    tunedCache[key] = localSize;
+    try
+    {
+        Poco::File(Poco::Path(getTunedPath()).setFileName("")).createDirectories();
+
+        //write to a temporary file and rename so readers never see a partial file,
+        //the temporary name is per process so concurrent writers do not interleave
+        const auto path = getTunedPath().toString();
+        const auto tmpPath = path+"."+std::to_string(Poco::Process::id())+".tmp";
+        {
+            std::ofstream file(tmpPath);
+            file << tunedCache.dump(4);
+            if (not file.good()) return;
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) std::remove(tmpPath.c_str());
+    }
+    catch (const Poco::Exception &ex)
+    {
+        std::cerr << "OpenCL local size cache: " << ex.displayText() << std::endl;
+    }
+}
+
+/***********************************************************************
+ * Local size tuner implementation
+ **********************************************************************/
+OpenClLocalSizeTuner::OpenClLocalSizeTuner(cl_kernel kernel, cl_device_id device, const std::string &key):
+    _key(key),
+    _maxSize(1)
+{
+    size_t multiple = 1;
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(_maxSize), &_maxSize, nullptr);
+    clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(multiple), &multiple, nullptr);
+    if (_maxSize == 0) _maxSize = 1;
+    if (multiple == 0 or multiple > _maxSize) multiple = 1;
+
+    //power of two multiples of the preferred multiple
+    for (size_t size = multiple; size <= _maxSize; size *= 2)
+    {
+        _candidates.push_back(size);
+    }
+}
+
+size_t OpenClLocalSizeTuner::bucketOf(const size_t globalSize)
+{
+    size_t bucket = 0;
+    while ((size_t(2) << bucket) <= globalSize) bucket++;
+    return bucket;
+}
+
+std::string OpenClLocalSizeTuner::bucketKey(const size_t globalSize, const size_t otherItems) const
+{
+    auto key = _key + "|" + std::to_string(bucketOf(globalSize));
+    if (otherItems > 1) key += "x" + std::to_string(otherItems);
+    return key;
+}
+
+OpenClLocalSizeTuner::Bucket &OpenClLocalSizeTuner::getBucket(const size_t globalSize, const size_t otherItems)
+{
+    const auto index = std::make_pair(bucketOf(globalSize), std::max<size_t>(1, otherItems));
+    auto it = _buckets.find(index);
+    if (it != _buckets.end()) return it->second;
+
+    auto &bucket = _buckets[index];
+    bucket.tuned = 0;
+    if (lookupTunedLocalSize(this->bucketKey(globalSize, otherItems), bucket.tuned)) return bucket;
+
+    //only time candidates that fit in the smallest global size of this bucket,
+    //and in the work-group size together with the other dimensions
+    const size_t maxSize = _maxSize/index.second;
+    for (const auto size : _candidates)
+    {
+        if (size > (size_t(1) << index.first) or size > maxSize) break;
+        bucket.trials[size] = Trial();
+    }
+    if (bucket.trials.empty()) bucket.tuned = std::max<size_t>(1, std::min(_candidates.front(), maxSize));
+    return bucket;
+}
+
+size_t OpenClLocalSizeTuner::nextLocalSize(const size_t globalSize, const size_t otherItems)
+{
+    auto &bucket = this->getBucket(globalSize, otherItems);
+    if (bucket.tuned != 0) return bucket.tuned;
+
+    //the candidate with the fewest measurements so far
+    auto next = bucket.trials.begin();
+    for (auto it = bucket.trials.begin(); it != bucket.trials.end(); ++it)
+    {
+        if (it->second.count < next->second.count) next = it;
+    }
+    return next->first;
+}
+
+void OpenClLocalSizeTuner::record(const size_t globalSize, const size_t otherItems, const size_t localSize, const size_t workItems, cl_event event)
+{
+    auto &bucket = this->getBucket(globalSize, otherItems);
+    if (bucket.tuned != 0) return;
+    auto it = bucket.trials.find(localSize);
+    if (it == bucket.trials.end()) return;
+
+    cl_ulong start = 0, end = 0;
+    cl_int err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+    if (err == 0) err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+
+    //without profiling information, settle on the first candidate
+    if (err < 0)
+    {
+        bucket.tuned = bucket.trials.begin()->first;
+        return;
+    }
+
+    if (workItems == 0) return;
+    it->second.count++;
+    it->second.nsPerElem += double(end-start)/workItems;
+
+    //pick the fastest candidate once all of them have been timed
+    double bestTime = std::numeric_limits<double>::max();
+    for (const auto &trial : bucket.trials)
+    {
+        if (trial.second.count < NUM_TRIALS_PER_CANDIDATE) return;
+        const double time = trial.second.nsPerElem/trial.second.count;
+        if (time >= bestTime) continue;
+        bestTime = time;
+        bucket.tuned = trial.first;
+    }
+    bucket.trials.clear();
+    storeTunedLocalSize(this->bucketKey(globalSize, otherItems), bucket.tuned);
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include "OpenClKernel.hpp"
+#include <map>
+
+/***********************************************************************
+ * Element-wise conversion between the wire type of a port
+ * and the compute type of the kernel. Complex elements are
+ * converted as pairs of scalars, and the offset is in scalars,
+ * so the kernel can start anywhere in a partially consumed buffer.
+ **********************************************************************/
+static const char *PORT_CONVERT_SOURCE =
+"__kernel void port_convert(\n"
+"    __global const IN_TYPE *in,\n"
+"    __global OUT_TYPE *out,\n"
+"    const uint offset,\n"
+"    const float scale\n"
+")\n"
+"{\n"
+"    const size_t i = get_global_id(0);\n"
+"    out[i] = OUT_CONVERT(convert_float(in[offset+i])*scale);\n"
+"}\n";
+
+std::string clScalarTypeName(const Pothos::DType &dtype)
+{
+    static const std::map<std::string, std::string> names = {
+        {"int8", "char"}, {"int16", "short"}, {"int32", "int"},
+        {"uint8", "uchar"}, {"uint16", "ushort"}, {"uint32", "uint"},
+        {"float32", "float"},
+    };
+    auto name = dtype.name();
+    if (dtype.isComplex()) name = name.substr(std::string("complex_").size());
+    const auto it = names.find(name);
+    if (it == names.end()) throw Pothos::Exception("clScalarTypeName("+dtype.toString()+")", "unsupported type");
+    return it->second;
+}
+
+std::shared_ptr<cl_kernel> makeOpenClPortConvertKernel(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const Pothos::DType &inputType,
+    const Pothos::DType &outputType)
+{
+    if (inputType.isComplex() != outputType.isComplex())
+    {
+        throw Pothos::Exception("makeOpenClPortConvertKernel("+inputType.toString()+", "+outputType.toString()+")", "cannot convert between real and complex");
+    }
+
+    const auto inName = clScalarTypeName(inputType);
+    const auto outName = clScalarTypeName(outputType);
+    const auto options = "-D IN_TYPE="+inName+" -D OUT_TYPE="+outName+
+        " -D OUT_CONVERT=convert_"+outName+((outName == "float")?"":"_sat_rte");
+    auto program = lookupProgramCache(context, device, PORT_CONVERT_SOURCE, options);
+
+    //the kernel holds a reference to its program
+    cl_int err = 0;
+    auto kernel = clCreateKernel(*program, "port_convert", &err);
+    if (err < 0) throw Pothos::Exception("makeOpenClPortConvertKernel::clCreateKernel()", clErrToStr(err));
+    return std::shared_ptr<cl_kernel>(new cl_kernel(kernel), clReleaseKernelPtr);
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include "OpenClKernel.hpp"
+#include <algorithm>
+
+#include <json.hpp>
+using json = nlohmann::json;
+
+/***********************************************************************
+ * Profiler implementation
+ **********************************************************************/
+static const size_t MAX_SAMPLES = 1024;
+static const size_t MAX_PENDING = 4096;
+
+OpenClProfiler::Stats::Stats(void):
+    totalBytes(0),
+    totalCount(0),
+    totalTime(0.0)
+{
+    return;
+}
+
+OpenClProfiler::OpenClProfiler(void):
+    _enabled(false)
+{
+    return;
+}
+
+void OpenClProfiler::setEnabled(const bool enabled)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (enabled and not _enabled)
+    {
+        _pending.clear();
+        for (auto &stats : _stats) stats = Stats();
+        _queueWaits.clear();
+        _launchTimes.clear();
+    }
+    _enabled = enabled;
+}
+
+void OpenClProfiler::record(const Kind kind, const std::shared_ptr<cl_event> &event, const size_t numBytes)
+{
+    if (not _enabled) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    Pending pending;
+    pending.kind = kind;
+    pending.event = event;
+    pending.numBytes = numBytes;
+    _pending.push_back(pending);
+    this->collect();
+}
+
+void OpenClProfiler::collect(void)
+{
+    while (not _pending.empty())
+    {
+        const auto &pending = _pending.front();
+
+        //events are recorded roughly in order of completion, stop at the first pending one,
+        //unless the backlog is too large because an event will never complete
+        cl_int status = CL_COMPLETE;
+        cl_int err = clGetEventInfo(*pending.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+        if (err == 0 and status > CL_COMPLETE and _pending.size() < MAX_PENDING) break;
+
+        cl_ulong queued = 0, start = 0, end = 0;
+        if (err == 0 and status == CL_COMPLETE) err = clGetEventProfilingInfo(*pending.event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, nullptr);
+        if (err == 0 and status == CL_COMPLETE) err = clGetEventProfilingInfo(*pending.event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+        if (err == 0 and status == CL_COMPLETE) err = clGetEventProfilingInfo(*pending.event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+        if (err == 0 and status == CL_COMPLETE)
+        {
+            auto &stats = _stats[pending.kind];
+            stats.durations.push_back((end-start)/1e3);
+            if (stats.durations.size() > MAX_SAMPLES) stats.durations.pop_front();
+            stats.totalBytes += pending.numBytes;
+            stats.totalCount++;
+            stats.totalTime += (end-start)/1e9;
+            if (pending.kind == KERNEL)
+            {
+                _queueWaits.push_back((start-queued)/1e3);
+                if (_queueWaits.size() > MAX_SAMPLES) _queueWaits.pop_front();
+                _launchTimes.push_back(end);
+                if (_launchTimes.size() > MAX_SAMPLES) _launchTimes.pop_front();
+            }
+        }
+        _pending.pop_front();
+    }
+}
+
+static json rollingStats(const std::deque<double> &samples)
+{
+    json stats;
+    stats["count"] = samples.size();
+    if (samples.empty()) return stats;
+
+    std::vector<double> sorted(samples.begin(), samples.end());
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (const auto sample : sorted) total += sample;
+    stats["min"] = sorted.front();
+    stats["mean"] = total/sorted.size();
+    stats["p99"] = sorted[std::min(sorted.size()-1, size_t(sorted.size()*0.99))];
+    stats["max"] = sorted.back();
+    return stats;
+}
+
+std::string OpenClProfiler::toJSON(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    this->collect();
+
+    json topObj;
+    static const char *names[] = {"kernel", "upload", "download"};
+    for (size_t kind = 0; kind < 3; kind++)
+    {
+        const auto &stats = _stats[kind];
+        auto &obj = topObj[names[kind]];
+        obj["durationUs"] = rollingStats(stats.durations);
+        obj["totalCount"] = stats.totalCount;
+        if (kind == KERNEL) continue;
+        obj["totalBytes"] = stats.totalBytes;
+        obj["bytesPerSecond"] = (stats.totalTime > 0.0)?(stats.totalBytes/stats.totalTime):0.0;
+    }
+    topObj["queueWaitUs"] = rollingStats(_queueWaits);
+
+    //launch rate from the device timestamps of the recent kernels
+    double launchesPerSecond = 0.0;
+    if (_launchTimes.size() > 1 and _launchTimes.back() > _launchTimes.front())
+    {
+        launchesPerSecond = (_launchTimes.size()-1)/((_launchTimes.back()-_launchTimes.front())/1e9);
+    }
+    topObj["launchesPerSecond"] = launchesPerSecond;
+    return topObj.dump();
+}
@@ -0,0 +1,317 @@
+// Copyright (c) 2014-2017 Josh Blum
+// SPDX-License-Identifier: BSL-1.0
+
+#include "OpenClKernel.hpp"
+#include <Pothos/Plugin.hpp>
+#include <Pothos/System.hpp>
+#include <Pothos/Exception.hpp>
+#include <Poco/MD5Engine.h>
+#include <Poco/Exception.h>
+#include <Poco/Environment.h>
+#include <Poco/NumberParser.h>
+#include <Poco/Timestamp.h>
+#include <Poco/Path.h>
+#include <Poco/File.h>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cstdio> //rename
+#include <vector>
+#include <mutex>
+#include <tuple>
+#include <map>
+
+/***********************************************************************
+ * The program binary cache stores CL_PROGRAM_BINARIES on disk,
+ * keyed by a hash of the source, build options, and device identity.
+ * Set POTHOS_OPENCL_CACHE_MAX_BYTES to bound the size (0 disables).
+ **********************************************************************/
+static const unsigned long long DEFAULT_CACHE_MAX_BYTES = 64*1024*1024;
+
+static std::mutex &getCacheMutex(void)
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static unsigned long long getCacheMaxBytes(void)
+{
+    const auto value = Poco::Environment::get("POTHOS_OPENCL_CACHE_MAX_BYTES", "");
+    if (value.empty()) return DEFAULT_CACHE_MAX_BYTES;
+    return Poco::NumberParser::parseUnsigned64(value);
+}
+
+static Poco::Path getCacheDirectory(void)
+{
+    Poco::Path path(Pothos::System::getUserDataPath());
+    path.makeDirectory();
+    path.pushDirectory("OpenClCache");
+    return path;
+}
+
+static std::string getDeviceInfoStr(cl_device_id device, cl_device_info what)
+{
+    char value[1024];
+    const cl_int err = clGetDeviceInfo(device, what, sizeof(value), value, nullptr);
+    if (err < 0) return "";
+    return value;
+}
+
+static std::string getPlatformInfoStr(cl_device_id device, cl_platform_info what)
+{
+    cl_platform_id platform = nullptr;
+    cl_int err = clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, nullptr);
+    if (err < 0) return "";
+    char value[1024];
+    err = clGetPlatformInfo(platform, what, sizeof(value), value, nullptr);
+    if (err < 0) return "";
+    return value;
+}
+
+static std::string getCacheKey(cl_device_id device, const std::string &source, const std::string &options)
+{
+    Poco::MD5Engine md5;
+    const std::string parts[] = {
+        source, options,
+        getPlatformInfoStr(device, CL_PLATFORM_NAME),
+        getPlatformInfoStr(device, CL_PLATFORM_VERSION),
+        getDeviceInfoStr(device, CL_DEVICE_NAME),
+        getDeviceInfoStr(device, CL_DEVICE_VERSION),
+        getDeviceInfoStr(device, CL_DRIVER_VERSION),
+    };
+    for (const auto &part : parts)
+    {
+        md5.update(part);
+        md5.update(std::string(1, '\0')); //delimit parts
+    }
+    return Poco::DigestEngine::digestToHex(md5.digest());
+}
+
+/***********************************************************************
+ * Cache file access
+ **********************************************************************/
+static bool loadCacheEntry(const std::string &key, std::vector<unsigned char> &binary)
+{
+    std::lock_guard<std::mutex> lock(getCacheMutex());
+    Poco::Path path(getCacheDirectory(), key+".bin");
+    std::ifstream file(path.toString(), std::ios::binary);
+    if (not file.good()) return false;
+    binary.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+
+    //touch the entry so pruning removes the least recently used first
+    try {Poco::File(path).setLastModified(Poco::Timestamp());}
+    catch (const Poco::Exception &) {}
+    return true;
+}
+
+static void removeCacheEntry(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(getCacheMutex());
+    try {Poco::File(Poco::Path(getCacheDirectory(), key+".bin")).remove();}
+    catch (const Poco::Exception &) {}
+}
+
+static void pruneCache(const unsigned long long maxBytes)
+{
+    std::vector<Poco::File> files;
+    Poco::File(getCacheDirectory()).list(files);
+    std::sort(files.begin(), files.end(), [](const Poco::File &a, const Poco::File &b)
+    {
+        return b.getLastModified() < a.getLastModified();
+    });
+
+    //keep the most recently used entries within the limit
+    unsigned long long totalBytes = 0;
+    for (auto &file : files)
+    {
+        totalBytes += file.getSize();
+        if (totalBytes <= maxBytes) continue;
+        try {file.remove();}
+        catch (const Poco::Exception &) {}
+    }
+}
+
+static void storeCacheEntry(const std::string &key, const std::vector<unsigned char> &binary)
+{
+    const auto maxBytes = getCacheMaxBytes();
+    if (binary.empty() or binary.size() > maxBytes) return;
+
+    std::lock_guard<std::mutex> lock(getCacheMutex());
+    try
+    {
+        Poco::File(getCacheDirectory()).createDirectories();
+
+        //write to a temporary file and rename so readers never see a partial entry
+        const auto path = Poco::Path(getCacheDirectory(), key+".bin").toString();
+        const auto tmpPath = path+".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+            file.write(reinterpret_cast<const char *>(binary.data()), binary.size());
+            if (not file.good()) return;
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) return;
+        pruneCache(maxBytes);
+    }
+    catch (const Poco::Exception &ex)
+    {
+        std::cerr << "OpenCL program cache: " << ex.displayText() << std::endl;
+    }
+}
+
+void clearProgramBinaryCache(void)
+{
+    std::lock_guard<std::mutex> lock(getCacheMutex());
+    Poco::File dir(getCacheDirectory());
+    if (dir.exists()) dir.remove(true/*recursive*/);
+}
+
+/***********************************************************************
+ * Build helpers
+ **********************************************************************/
+static void buildProgram(cl_program program, cl_device_id device, const std::string &options)
+{
+    const cl_int err = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+    if (err < 0)
+    {
+        /* Find size of log and print to std output */
+        size_t logSize = 0;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+        std::vector<char> errorLog(logSize);
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, errorLog.data(), nullptr);
+
+        std::string errorString(errorLog.begin(), errorLog.end());
+        throw Pothos::Exception("OpenClKernel::clBuildProgram()", errorString);
+    }
+}
+
+static std::vector<unsigned char> getProgramBinary(cl_program program)
+{
+    size_t binarySize = 0;
+    cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, nullptr);
+    if (err < 0 or binarySize == 0) return std::vector<unsigned char>();
+
+    std::vector<unsigned char> binary(binarySize);
+    unsigned char *binaryPtr = binary.data();
+    err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaryPtr), &binaryPtr, nullptr);
+    if (err < 0) return std::vector<unsigned char>();
+    return binary;
+}
+
+static std::shared_ptr<cl_program> buildProgramFromBinary(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const std::vector<unsigned char> &binary,
+    const std::string &options)
+{
+    cl_int err = 0, status = 0;
+    const unsigned char *binaryPtr = binary.data();
+    const size_t binarySize = binary.size();
+    auto program = clCreateProgramWithBinary(*context, 1, &device, &binarySize, &binaryPtr, &status, &err);
+    if (err < 0 or status < 0) return std::shared_ptr<cl_program>();
+    std::shared_ptr<cl_program> programSptr(new cl_program(program), clReleaseProgramPtr);
+
+    try {buildProgram(program, device, options);}
+    catch (const Pothos::Exception &) {return std::shared_ptr<cl_program>();}
+    return programSptr;
+}
+
+std::shared_ptr<cl_program> buildOpenClProgram(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const std::string &source,
+    const std::string &options)
+{
+    const bool cacheEnabled = getCacheMaxBytes() != 0;
+    const auto key = cacheEnabled?getCacheKey(device, source, options):"";
+
+    //try the cached binary, a stale or rejected entry falls back to source
+    std::vector<unsigned char> binary;
+    if (cacheEnabled and loadCacheEntry(key, binary))
+    {
+        auto program = buildProgramFromBinary(context, device, binary, options);
+        if (program) return program;
+        removeCacheEntry(key);
+    }
+
+    /* Create program from source */
+    cl_int err = 0;
+    const char *sourcePtr = source.data();
+    const size_t sourceSize = source.size();
+    auto program = clCreateProgramWithSource(*context, 1, &sourcePtr, &sourceSize, &err);
+    if (err < 0) throw Pothos::Exception("OpenClKernel::clCreateProgramWithSource()", clErrToStr(err));
+    std::shared_ptr<cl_program> programSptr(new cl_program(program), clReleaseProgramPtr);
+
+    /* Build program */
+    buildProgram(program, device, options);
+
+    if (cacheEnabled) storeCacheEntry(key, getProgramBinary(program));
+    return programSptr;
+}
+
+/***********************************************************************
+ * In-process cache so blocks with the same source share one program.
+ * Entries hold a weak reference to their context: the entries of a
+ * released context are erased, and are never matched by a new context
+ * that happens to reuse the handle of a released one.
+ **********************************************************************/
+struct ProgramCacheEntry
+{
+    std::mutex mutex;
+    std::weak_ptr<cl_context> context;
+    std::weak_ptr<cl_program> program;
+};
+
+std::shared_ptr<cl_program> lookupProgramCache(
+    const std::shared_ptr<cl_context> &context,
+    cl_device_id device,
+    const std::string &source,
+    const std::string &options)
+{
+    Poco::MD5Engine md5;
+    md5.update(source);
+    md5.update(std::string(1, '\0'));
+    md5.update(options);
+    const auto key = std::make_tuple(*context, device, Poco::DigestEngine::digestToHex(md5.digest()));
+
+    std::shared_ptr<ProgramCacheEntry> entry;
+    {
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+
+        static std::map<decltype(key), std::shared_ptr<ProgramCacheEntry>> programCache;
+        for (auto it = programCache.begin(); it != programCache.end();)
+        {
+            if (it->second->context.expired()) it = programCache.erase(it);
+            else ++it;
+        }
+
+        auto &entrySptr = programCache[key];
+        if (not entrySptr or entrySptr->context.lock() != context)
+        {
+            entrySptr.reset(new ProgramCacheEntry());
+            entrySptr->context = context;
+        }
+        entry = entrySptr;
+    }
+
+    //build outside of the cache lock so different programs build in parallel,
+    //blocks requesting the same program wait here for the first build
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    auto programSptr = entry->program.lock();
+    if (not programSptr)
+    {
+        programSptr = buildOpenClProgram(context, device, source, options);
+        entry->program = programSptr;
+    }
+    return programSptr;
+}
+
+/***********************************************************************
+ * Registration
+ **********************************************************************/
+pothos_static_block(registerOpenClProgramCache)
+{
+    Pothos::PluginRegistry::addCall(
+        "/devices/opencl/clear_cache", &clearProgramBinaryCache);
+}
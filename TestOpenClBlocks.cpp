@@ -4,8 +4,18 @@
 #include <Pothos/Testing.hpp>
 #include <Pothos/Framework.hpp>
 #include <Pothos/Proxy.hpp>
+#include <Pothos/Plugin.hpp>
+#include <Pothos/System.hpp>
 #include <Poco/JSON/Object.h>
+#include <Poco/Environment.h>
+#include <Poco/File.h>
+#include <Poco/Path.h>
 #include <iostream>
+#include <fstream>
+#include <algorithm> //max
+#include <complex>
+#include <vector>
+#include <cmath>
 
 #include <json.hpp>
 using json = nlohmann::json;
@@ -38,6 +48,97 @@ static const char *KERNEL_SOURCE =
 "    const uint i = get_global_id(0);\n"
 "    out[i] = in[i];\n"
 "}"
+"\n"
+"#ifndef SCALE\n"
+"#define SCALE 1\n"
+"#endif\n"
+"__kernel void scale_int(\n"
+"    __global const int* in,\n"
+"    __global int* out\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    out[i] = in[i]*SCALE;\n"
+"}"
+"\n"
+"__kernel void add_row_int(\n"
+"    __global const int* in,\n"
+"    __global int* out,\n"
+"    const uint cols,\n"
+"    const uint rows\n"
+")\n"
+"{\n"
+"    const uint c = get_global_id(0);\n"
+"    const uint r = get_global_id(1);\n"
+"    if (c >= cols || r >= rows) return;\n"
+"    out[r*cols+c] = in[r*cols+c] + r;\n"
+"}"
+"\n"
+"__kernel void affine_int(\n"
+"    __global const int* in,\n"
+"    __global int* out,\n"
+"    const int gain,\n"
+"    __constant int* offsets,\n"
+"    __local int* scratch\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    const uint l = get_local_id(0);\n"
+"    scratch[l] = in[i]*gain;\n"
+"    barrier(CLK_LOCAL_MEM_FENCE);\n"
+"    out[i] = scratch[l] + offsets[i%4];\n"
+"}"
+"\n"
+"__kernel void copy_int_offset(\n"
+"    __global const int* in,\n"
+"    __global int* out,\n"
+"    const uint inOffset\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    out[i] = in[inOffset+i];\n"
+"}"
+"\n"
+"__kernel void sum3_int(\n"
+"    __global const int* in,\n"
+"    __global int* out\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    out[i] = in[i] + in[i+1] + in[i+2];\n"
+"}"
+"\n"
+"__kernel void keep_positive_int(\n"
+"    __global const int* in,\n"
+"    __global int* out,\n"
+"    __global uint* counts\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    if (in[i] > 0) out[atomic_inc(&counts[0])] = in[i];\n"
+"}"
+"\n"
+"__kernel void packet_double_int(\n"
+"    __global const int* in,\n"
+"    __global int* out,\n"
+"    __global const uint* offsets,\n"
+"    __global const uint* lengths,\n"
+"    const uint numPackets\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    if (i >= offsets[numPackets-1] + lengths[numPackets-1]) return;\n"
+"    out[i] = in[i]*2;\n"
+"}"
+"\n"
+"__kernel void double_float32(\n"
+"    __global const float* in,\n"
+"    __global float* out\n"
+")\n"
+"{\n"
+"    const uint i = get_global_id(0);\n"
+"    out[i] = in[i]*2;\n"
+"}"
 ;
 
 POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel)
@@ -147,6 +248,231 @@ POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_back_to_back)
     for (int i = 0; i < 10; i++) POTHOS_TEST_EQUAL(pb[i], float(i+i+10+i+20));
 }
 
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_chain)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "float32");
+    auto feeder0 = registry.call("/blocks/feeder_source", "float32");
+    auto feeder1 = registry.call("/blocks/feeder_source", "float32");
+
+    //the sum stays in device memory between the three stages
+    std::vector<std::string> names;
+    names.push_back("add_2x_float32");
+    names.push_back("double_float32");
+    names.push_back("double_float32");
+    auto openClKernel = registry.call("/blocks/opencl_kernel_chain", "0:0", std::vector<std::string>(2, "float"), std::vector<std::string>(1, "float"));
+    openClKernel.call("setKernelChain", names, KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    POTHOS_TEST_EQUAL(openClKernel.call<std::vector<std::string>>("getKernelChain").size(), 3);
+
+    //feed buffer
+    auto b0 = Pothos::BufferChunk(10*sizeof(float));
+    auto p0 = b0.as<float *>();
+    for (size_t i = 0; i < 10; i++) p0[i] = i;
+    feeder0.call("feedBuffer", b0);
+
+    auto b1 = Pothos::BufferChunk(10*sizeof(float));
+    auto p1 = b1.as<float *>();
+    for (size_t i = 0; i < 10; i++) p1[i] = i+10;
+    feeder1.call("feedBuffer", b1);
+
+    //run the topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder0, 0, openClKernel, 0);
+        topology.connect(feeder1, 0, openClKernel, 1);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //check the buffer for equality
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 10*sizeof(float));
+    auto pb = buff.as<const float *>();
+    for (int i = 0; i < 10; i++) POTHOS_TEST_EQUAL(pb[i], float((i+i+10)*4));
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_device_resident)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+
+    //only kernel consumers, and then a host consumer on the same output
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        auto collector = registry.call("/blocks/collector_sink", "int");
+        auto tap = registry.call("/blocks/collector_sink", "int");
+        auto feeder = registry.call("/blocks/feeder_source", "int");
+
+        auto openClKernel0 = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+        openClKernel0.call("setSource", "copy_int", KERNEL_SOURCE);
+        openClKernel0.call("setLocalSize", 1);
+        openClKernel0.call("setPipelineDepth", 3);
+        openClKernel0.call("setProfilingEnabled", true);
+
+        auto openClKernel1 = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+        openClKernel1.call("setSource", "copy_int", KERNEL_SOURCE);
+        openClKernel1.call("setLocalSize", 1);
+        openClKernel1.call("setPipelineDepth", 3);
+        openClKernel1.call("setProfilingEnabled", true);
+
+        json testPlan;
+        testPlan["enableBuffers"] = true;
+        testPlan["enableLabels"] = true;
+        testPlan["minTrials"] = 100;
+        testPlan["maxTrials"] = 200;
+        testPlan["minSize"] = 100;
+        testPlan["maxSize"] = 1000;
+        auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+        {
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, openClKernel0, 0);
+            topology.connect(openClKernel0, 0, openClKernel1, 0);
+            if (pass == 1) topology.connect(openClKernel0, 0, tap, 0);
+            topology.connect(openClKernel1, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive());
+        }
+
+        collector.call("verifyTestPlan", expected);
+        if (pass == 1) tap.call("verifyTestPlan", expected);
+
+        //the hand-off between the kernels never went through host memory
+        if (pass == 0)
+        {
+            const auto stats0 = json::parse(openClKernel0.call<std::string>("getProfilingStats"));
+            const auto stats1 = json::parse(openClKernel1.call<std::string>("getProfilingStats"));
+            POTHOS_TEST_EQUAL(stats0["download"]["totalCount"].get<size_t>(), 0);
+            POTHOS_TEST_EQUAL(stats1["upload"]["totalCount"].get<size_t>(), 0);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_binary_cache)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    Pothos::PluginRegistry::get("/devices/opencl/clear_cache").getObject().extract<Pothos::Callable>().call();
+
+    Poco::Path cacheDir(Pothos::System::getUserDataPath());
+    cacheDir.makeDirectory();
+    cacheDir.pushDirectory("OpenClCache");
+    const bool cacheEnabled = Poco::Environment::get("POTHOS_OPENCL_CACHE_MAX_BYTES", "") != "0";
+    POTHOS_TEST_TRUE(not Poco::File(cacheDir).exists());
+
+    //a source that no other test builds
+    const std::string source =
+        "__kernel void add_7_int(\n"
+        "    __global const int* in,\n"
+        "    __global int* out\n"
+        ")\n"
+        "{\n"
+        "    const uint i = get_global_id(0);\n"
+        "    out[i] = in[i] + 7;\n"
+        "}";
+
+    //the blocks are released after each pass, so the next build
+    //does not find the program in the in-process cache
+    for (size_t pass = 0; pass < 3; pass++)
+    {
+        //a corrupted entry is rejected and rebuilt from source
+        if (pass == 2 and cacheEnabled)
+        {
+            std::vector<std::string> names;
+            Poco::File(cacheDir).list(names);
+            for (const auto &name : names)
+            {
+                std::ofstream file(Poco::Path(cacheDir, name).toString(), std::ios::binary|std::ios::trunc);
+                file << "not a program binary";
+            }
+        }
+
+        auto collector = registry.call("/blocks/collector_sink", "int");
+        auto feeder = registry.call("/blocks/feeder_source", "int");
+        auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+        openClKernel.call("setSource", "add_7_int", source);
+        openClKernel.call("setLocalSize", 1);
+
+        auto b0 = Pothos::BufferChunk(10*sizeof(int));
+        auto p0 = b0.as<int *>();
+        for (size_t i = 0; i < 10; i++) p0[i] = i;
+        feeder.call("feedBuffer", b0);
+
+        {
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, openClKernel, 0);
+            topology.connect(openClKernel, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive());
+        }
+
+        Pothos::BufferChunk buff = collector.call("getBuffer");
+        POTHOS_TEST_EQUAL(buff.length, 10*sizeof(int));
+        auto pb = buff.as<const int *>();
+        for (int i = 0; i < 10; i++) POTHOS_TEST_EQUAL(pb[i], i+7);
+
+        //the first build stored the binary
+        if (cacheEnabled)
+        {
+            std::vector<std::string> names;
+            Poco::File(cacheDir).list(names);
+            POTHOS_TEST_TRUE(not names.empty());
+        }
+    }
+
+    Pothos::PluginRegistry::get("/devices/opencl/clear_cache").getObject().extract<Pothos::Callable>().call();
+    POTHOS_TEST_TRUE(not Poco::File(cacheDir).exists());
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_queue_modes)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+
+    //a chain into two independent branches, every kernel on the device's queue
+    for (const std::string mode : {"SHARED", "OUT_OF_ORDER"})
+    {
+        auto collector0 = registry.call("/blocks/collector_sink", "int");
+        auto collector1 = registry.call("/blocks/collector_sink", "int");
+        auto feeder = registry.call("/blocks/feeder_source", "int");
+
+        std::vector<Pothos::Proxy> kernels;
+        for (size_t i = 0; i < 3; i++)
+        {
+            auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+            openClKernel.call("setSource", "copy_int", KERNEL_SOURCE);
+            openClKernel.call("setLocalSize", 1);
+            openClKernel.call("setPipelineDepth", 3);
+            openClKernel.call("setQueueMode", mode);
+            POTHOS_TEST_EQUAL(openClKernel.call<std::string>("getQueueMode"), mode);
+            kernels.push_back(openClKernel);
+        }
+        POTHOS_TEST_THROWS(kernels[0].call("setQueueMode", "FOO"), Pothos::ProxyExceptionMessage);
+
+        json testPlan;
+        testPlan["enableBuffers"] = true;
+        testPlan["enableLabels"] = true;
+        testPlan["minTrials"] = 100;
+        testPlan["maxTrials"] = 200;
+        testPlan["minSize"] = 100;
+        testPlan["maxSize"] = 1000;
+        auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+        {
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, kernels[0], 0);
+            topology.connect(kernels[0], 0, kernels[1], 0);
+            topology.connect(kernels[0], 0, kernels[2], 0);
+            topology.connect(kernels[1], 0, collector0, 0);
+            topology.connect(kernels[2], 0, collector1, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive());
+        }
+
+        collector0.call("verifyTestPlan", expected);
+        collector1.call("verifyTestPlan", expected);
+    }
+}
+
 POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_middle_man)
 {
     auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
@@ -193,3 +519,1014 @@ POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_middle_man)
     std::cout << "collectorMiddle verifyTestPlan" << std::endl;
     collectorMiddle.call("verifyTestPlan", expected);
 }
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_pipelined)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setPipelineDepth", 3);
+    POTHOS_TEST_EQUAL(openClKernel.call<size_t>("getPipelineDepth"), 3);
+    openClKernel.call("setProfilingEnabled", true);
+
+    //create test plan with labels to check their position
+    json testPlan;
+    testPlan["enableBuffers"] = true;
+    testPlan["enableLabels"] = true;
+    testPlan["minTrials"] = 100;
+    testPlan["maxTrials"] = 200;
+    testPlan["minSize"] = 512;
+    testPlan["maxSize"] = 1024;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    collector.call("verifyTestPlan", expected);
+
+    //every launch was profiled
+    const auto stats = json::parse(openClKernel.call<std::string>("getProfilingStats"));
+    std::cout << stats.dump(4) << std::endl;
+    POTHOS_TEST_TRUE(stats["kernel"]["totalCount"].get<size_t>() > 0);
+    POTHOS_TEST_TRUE(stats["upload"]["totalBytes"].get<size_t>() > 0);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_split)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+
+    //the same device listed twice: the second entry has its own queue,
+    //and runs its share through host memory like another device would
+    auto upstream = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    upstream.call("setSource", "copy_int", KERNEL_SOURCE);
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0, 0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setPipelineDepth", 2);
+
+    //large enough buffers to split, host inputs and then device resident inputs
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        auto collector = registry.call("/blocks/collector_sink", "int");
+        auto feeder = registry.call("/blocks/feeder_source", "int");
+        json testPlan;
+        testPlan["enableBuffers"] = true;
+        testPlan["minTrials"] = 20;
+        testPlan["maxTrials"] = 40;
+        testPlan["minSize"] = 2048;
+        testPlan["maxSize"] = 4096;
+        auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+        {
+            Pothos::Topology topology;
+            if (pass == 0) topology.connect(feeder, 0, openClKernel, 0);
+            else
+            {
+                topology.connect(feeder, 0, upstream, 0);
+                topology.connect(upstream, 0, openClKernel, 0);
+            }
+            topology.connect(openClKernel, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive());
+        }
+
+        collector.call("verifyTestPlan", expected);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_defines)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "scale_int", KERNEL_SOURCE);
+    openClKernel.call("setBuildOptions", "-cl-mad-enable");
+    Pothos::ObjectKwargs defines;
+    defines["SCALE"] = Pothos::Object(3);
+    openClKernel.call("setDefines", defines);
+    openClKernel.call("setLocalSize", 1);
+
+    //feed buffer
+    auto b0 = Pothos::BufferChunk(10*sizeof(int));
+    auto p0 = b0.as<int *>();
+    for (size_t i = 0; i < 10; i++) p0[i] = i;
+    feeder.call("feedBuffer", b0);
+
+    //run the topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //check the buffer for the specialized scale
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 10*sizeof(int));
+    auto pb = buff.as<const int *>();
+    for (int i = 0; i < 10; i++) POTHOS_TEST_EQUAL(pb[i], i*3);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_background_build)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    //each call starts a build, the last one is used when the topology is activated
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "scale_int", KERNEL_SOURCE);
+    for (int scale = 2; scale <= 5; scale++)
+    {
+        Pothos::ObjectKwargs defines;
+        defines["SCALE"] = Pothos::Object(scale);
+        openClKernel.call("setDefines", defines);
+    }
+    openClKernel.call("setLocalSize", 1);
+
+    //feed buffer
+    auto b0 = Pothos::BufferChunk(10*sizeof(int));
+    auto p0 = b0.as<int *>();
+    for (size_t i = 0; i < 10; i++) p0[i] = i;
+    feeder.call("feedBuffer", b0);
+
+    //run the topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //check the buffer for the last specialization
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 10*sizeof(int));
+    auto pb = buff.as<const int *>();
+    for (int i = 0; i < 10; i++) POTHOS_TEST_EQUAL(pb[i], i*5);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_2d)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    //3 columns per frame with a local size of 2 pads the global size
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "add_row_int", KERNEL_SOURCE);
+    openClKernel.call("setFrameShape", std::vector<size_t>(1, 3));
+    openClKernel.call("setLocalShape", std::vector<size_t>{2, 1});
+
+    //feed buffer
+    auto b0 = Pothos::BufferChunk(12*sizeof(int));
+    auto p0 = b0.as<int *>();
+    for (size_t i = 0; i < 12; i++) p0[i] = i;
+    feeder.call("feedBuffer", b0);
+
+    //run the topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //each element is offset by its row (frame) index
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 12*sizeof(int));
+    auto pb = buff.as<const int *>();
+    for (int i = 0; i < 12; i++) POTHOS_TEST_EQUAL(pb[i], i+i/3);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_args)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "affine_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setScalarArg", 2, "int32", 3.0);
+    openClKernel.call("setConstantArg", 3, "int32", std::vector<double>{1, 2, 3, 4});
+    openClKernel.call("setLocalArg", 4, sizeof(int));
+
+    //feed buffer
+    auto b0 = Pothos::BufferChunk(12*sizeof(int));
+    auto p0 = b0.as<int *>();
+    for (size_t i = 0; i < 12; i++) p0[i] = i;
+    feeder.call("feedBuffer", b0);
+
+    //run the topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //check the gain and the constant offsets
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 12*sizeof(int));
+    auto pb = buff.as<const int *>();
+    for (int i = 0; i < 12; i++) POTHOS_TEST_EQUAL(pb[i], i*3+(i%4)+1);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_circular)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    //a small ring with tuned local sizes leaves remainders that wrap around the ring
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int_offset", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 0);
+    openClKernel.call("setBufferSize", 4096);
+    openClKernel.call("setBufferMode", "CIRCULAR");
+    POTHOS_TEST_EQUAL(openClKernel.call<std::string>("getBufferMode"), "CIRCULAR");
+
+    json testPlan;
+    testPlan["enableBuffers"] = true;
+    testPlan["enableLabels"] = true;
+    testPlan["minTrials"] = 100;
+    testPlan["maxTrials"] = 200;
+    testPlan["minSize"] = 100;
+    testPlan["maxSize"] = 1000;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_circular_out_of_order)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    //launches in flight on an out of order queue, wrapped windows share the scratch space past the ring
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int_offset", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 0);
+    openClKernel.call("setBufferSize", 4096);
+    openClKernel.call("setBufferMode", "CIRCULAR");
+    openClKernel.call("setQueueMode", "OUT_OF_ORDER");
+    openClKernel.call("setPipelineDepth", 4);
+
+    json testPlan;
+    testPlan["enableBuffers"] = true;
+    testPlan["enableLabels"] = true;
+    testPlan["minTrials"] = 100;
+    testPlan["maxTrials"] = 200;
+    testPlan["minSize"] = 100;
+    testPlan["maxSize"] = 1000;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_svm)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    //inputs and outputs in shared virtual memory, mapped and unmapped around host access
+    //by several launches in flight, devices without SVM support use discrete buffers
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setPipelineDepth", 3);
+    openClKernel.call("setBufferMode", "SVM");
+    POTHOS_TEST_EQUAL(openClKernel.call<std::string>("getBufferMode"), "SVM");
+
+    json testPlan;
+    testPlan["enableBuffers"] = true;
+    testPlan["enableLabels"] = true;
+    testPlan["minTrials"] = 100;
+    testPlan["maxTrials"] = 200;
+    testPlan["minSize"] = 100;
+    testPlan["maxSize"] = 1000;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_zero_copy)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    //on unified memory devices the discrete mode wraps host memory: a few small buffers
+    //are unmapped for launches in flight and mapped again many times when recycled,
+    //and upstream buffers larger than ours are partially consumed
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setPipelineDepth", 4);
+    openClKernel.call("setBufferSize", 1024);
+    openClKernel.call("setBufferMode", "DISCRETE");
+
+    json testPlan;
+    testPlan["enableBuffers"] = true;
+    testPlan["enableLabels"] = true;
+    testPlan["minTrials"] = 100;
+    testPlan["maxTrials"] = 200;
+    testPlan["minSize"] = 10;
+    testPlan["maxSize"] = 2000;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_history)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "sum3_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setPipelineDepth", 2);
+    openClKernel.call("setHistory", 0, 2);
+    POTHOS_TEST_EQUAL(openClKernel.call<size_t>("getHistory", 0), 2);
+
+    //several buffers so that the history crosses launches
+    int value = 0;
+    for (size_t n = 0; n < 5; n++)
+    {
+        auto b = Pothos::BufferChunk(10*sizeof(int));
+        auto p = b.as<int *>();
+        for (size_t i = 0; i < 10; i++) p[i] = value++;
+        feeder.call("feedBuffer", b);
+    }
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //each output is the sum of the input and the two before it, starting from zeros
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 50*sizeof(int));
+    auto pb = buff.as<const int *>();
+    for (int i = 0; i < 50; i++)
+    {
+        POTHOS_TEST_EQUAL(pb[i], std::max(i-2, 0) + std::max(i-1, 0) + i);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_batching)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "copy_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setMinBatch", 1000);
+    openClKernel.call("setMaxBatch", 1500);
+    openClKernel.call("setBatchTimeout", 0.001);
+    POTHOS_TEST_EQUAL(openClKernel.call<size_t>("getMaxBatch"), 1500);
+
+    //small payloads are batched, and the tail is flushed by the timeout
+    json testPlan;
+    testPlan["enableBuffers"] = true;
+    testPlan["enableLabels"] = true;
+    testPlan["minTrials"] = 100;
+    testPlan["maxTrials"] = 200;
+    testPlan["minSize"] = 10;
+    testPlan["maxSize"] = 100;
+    auto expected = feeder.call("feedTestPlan", testPlan.dump());
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    collector.call("verifyTestPlan", expected);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_variable_output)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "keep_positive_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 1);
+    openClKernel.call("setVariableOutput", true);
+
+    //feed buffer
+    auto b0 = Pothos::BufferChunk(20*sizeof(int));
+    auto p0 = b0.as<int *>();
+    for (size_t i = 0; i < 20; i++) p0[i] = int(i)-5;
+    feeder.call("feedBuffer", b0);
+
+    //run the topology
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //only the positive elements are produced, in the order of the atomic counter
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 14*sizeof(int));
+    std::vector<int> produced(buff.as<const int *>(), buff.as<const int *>()+14);
+    std::sort(produced.begin(), produced.end());
+    for (int i = 0; i < 14; i++) POTHOS_TEST_EQUAL(produced[i], i+1);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_packets)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int");
+    auto feeder = registry.call("/blocks/feeder_source", "int");
+
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "packet_double_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 4);
+    openClKernel.call("setPacketMode", true);
+
+    //packets of different lengths, batched into launches
+    const size_t numPackets = 20;
+    for (size_t p = 0; p < numPackets; p++)
+    {
+        Pothos::Packet packet;
+        packet.payload = Pothos::BufferChunk("int", p+1);
+        for (size_t i = 0; i <= p; i++) packet.payload.as<int *>()[i] = int(p*100+i);
+        packet.metadata["index"] = Pothos::Object(p);
+        feeder.call("feedPacket", packet);
+    }
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //each packet keeps its boundaries and metadata
+    const std::vector<Pothos::Packet> packets = collector.call("getPackets");
+    POTHOS_TEST_EQUAL(packets.size(), numPackets);
+    for (size_t p = 0; p < numPackets; p++)
+    {
+        POTHOS_TEST_EQUAL(packets[p].payload.length, (p+1)*sizeof(int));
+        POTHOS_TEST_EQUAL(packets[p].metadata.at("index").convert<size_t>(), p);
+        const auto pb = packets[p].payload.as<const int *>();
+        for (size_t i = 0; i <= p; i++) POTHOS_TEST_EQUAL(pb[i], int(p*100+i)*2);
+    }
+}
+
+/***********************************************************************
+ * Emit a sequence of messages, and record messages in arrival order,
+ * packets and other messages alike, unlike the feeder and collector
+ **********************************************************************/
+class MessageSequenceSource : public Pothos::Block
+{
+public:
+    MessageSequenceSource(const std::vector<Pothos::Object> &messages):
+        _messages(messages)
+    {
+        this->setupOutput(0);
+    }
+
+    void work(void)
+    {
+        for (const auto &msg : _messages) this->output(0)->postMessage(msg);
+        _messages.clear();
+    }
+
+private:
+    std::vector<Pothos::Object> _messages;
+};
+
+class MessageSequenceSink : public Pothos::Block
+{
+public:
+    MessageSequenceSink(void)
+    {
+        this->setupInput(0);
+    }
+
+    void work(void)
+    {
+        auto inPort = this->input(0);
+        while (inPort->hasMessage()) messages.push_back(inPort->popMessage());
+    }
+
+    std::vector<Pothos::Object> messages;
+};
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_packets_message_order)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0", std::vector<std::string>(1, "int"), std::vector<std::string>(1, "int"));
+    openClKernel.call("setSource", "packet_double_int", KERNEL_SOURCE);
+    openClKernel.call("setLocalSize", 4);
+    openClKernel.call("setPacketMode", true);
+    openClKernel.call("setMaxBatch", 8);
+    openClKernel.call("setPipelineDepth", 3);
+
+    //non-packet messages and empty packets in between packets,
+    //some in the same batch as packets, some between launches in flight
+    std::vector<Pothos::Object> input;
+    for (size_t p = 0; p < 12; p++)
+    {
+        Pothos::Packet packet;
+        packet.payload = Pothos::BufferChunk("int", (p%3 == 2)?0:p+1);
+        for (size_t i = 0; i < packet.payload.elements(); i++) packet.payload.as<int *>()[i] = int(p*100+i);
+        packet.metadata["index"] = Pothos::Object(p);
+        input.emplace_back(packet);
+        if (p%4 == 1) input.emplace_back(std::string("marker")+std::to_string(p));
+    }
+
+    auto source = std::shared_ptr<MessageSequenceSource>(new MessageSequenceSource(input));
+    auto sink = std::shared_ptr<MessageSequenceSink>(new MessageSequenceSink());
+    {
+        Pothos::Topology topology;
+        topology.connect(source, 0, openClKernel, 0);
+        topology.connect(openClKernel, 0, sink, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //the output sequence matches the input sequence one for one
+    POTHOS_TEST_EQUAL(sink->messages.size(), input.size());
+    for (size_t m = 0; m < input.size(); m++)
+    {
+        const auto &in = input[m];
+        const auto &out = sink->messages[m];
+        POTHOS_TEST_TRUE(in.type() == out.type());
+        if (in.type() != typeid(Pothos::Packet))
+        {
+            POTHOS_TEST_EQUAL(out.extract<std::string>(), in.extract<std::string>());
+            continue;
+        }
+        const auto &inPacket = in.extract<Pothos::Packet>();
+        const auto &outPacket = out.extract<Pothos::Packet>();
+        POTHOS_TEST_EQUAL(outPacket.metadata.at("index").convert<size_t>(), inPacket.metadata.at("index").convert<size_t>());
+        POTHOS_TEST_EQUAL(outPacket.payload.length, inPacket.payload.length);
+        const auto pin = inPacket.payload.as<const int *>();
+        const auto pout = outPacket.payload.as<const int *>();
+        for (size_t i = 0; i < inPacket.payload.elements(); i++) POTHOS_TEST_EQUAL(pout[i], pin[i]*2);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_kernel_compute_types)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "complex_int16");
+    auto feeder0 = registry.call("/blocks/feeder_source", "complex_int16");
+    auto feeder1 = registry.call("/blocks/feeder_source", "complex_int16");
+
+    //the ports carry complex_int16, the kernel adds complex floats
+    auto openClKernel = registry.call("/blocks/opencl_kernel", "0:0",
+        std::vector<std::string>(2, "complex_int16"), std::vector<std::string>(1, "complex_int16"));
+    openClKernel.call("setSource", "add_2x_complex64", KERNEL_SOURCE);
+    openClKernel.call("setInputComputeType", 0, "complex_float32", 0.5);
+    openClKernel.call("setInputComputeType", 1, "complex_float32", 0.5);
+    openClKernel.call("setOutputComputeType", 0, "complex_float32", 2.0);
+
+    auto b0 = Pothos::BufferChunk("complex_int16", 10);
+    auto b1 = Pothos::BufferChunk("complex_int16", 10);
+    auto p0 = b0.as<std::complex<short> *>();
+    auto p1 = b1.as<std::complex<short> *>();
+    for (size_t i = 0; i < 10; i++)
+    {
+        p0[i] = std::complex<short>(i*3000, -short(i));
+        p1[i] = std::complex<short>(i*1000, 7);
+    }
+    feeder0.call("feedBuffer", b0);
+    feeder1.call("feedBuffer", b1);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder0, 0, openClKernel, 0);
+        topology.connect(feeder1, 0, openClKernel, 1);
+        topology.connect(openClKernel, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //the sum is saturated to the output type
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 10*sizeof(std::complex<short>));
+    auto pb = buff.as<const std::complex<short> *>();
+    for (size_t i = 0; i < 10; i++)
+    {
+        POTHOS_TEST_EQUAL(pb[i].real(), short(std::min<int>(i*4000, 32767)));
+        POTHOS_TEST_EQUAL(pb[i].imag(), short(7-int(i)));
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_complex_multiply)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+    auto feeder0 = registry.call("/blocks/feeder_source", "complex_float32");
+    auto feeder1 = registry.call("/blocks/feeder_source", "complex_float32");
+    auto multiply = registry.call("/blocks/opencl_complex_multiply", "0:0");
+
+    //not a multiple of the vector width, the last work-item processes the remainder
+    auto b0 = Pothos::BufferChunk("complex_float32", 18);
+    auto b1 = Pothos::BufferChunk("complex_float32", 18);
+    auto p0 = b0.as<std::complex<float> *>();
+    auto p1 = b1.as<std::complex<float> *>();
+    for (size_t i = 0; i < 18; i++)
+    {
+        p0[i] = std::complex<float>(i, 1.0f);
+        p1[i] = std::complex<float>(2.0f, -float(i));
+    }
+    feeder0.call("feedBuffer", b0);
+    feeder1.call("feedBuffer", b1);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder0, 0, multiply, 0);
+        topology.connect(feeder1, 0, multiply, 1);
+        topology.connect(multiply, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 18*sizeof(std::complex<float>));
+    auto pb = buff.as<const std::complex<float> *>();
+    for (size_t i = 0; i < 18; i++)
+    {
+        const auto expected = p0[i]*p1[i];
+        POTHOS_TEST_CLOSE(pb[i].real(), expected.real(), 1e-3);
+        POTHOS_TEST_CLOSE(pb[i].imag(), expected.imag(), 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_fir_decimator)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "float32");
+    auto feeder = registry.call("/blocks/feeder_source", "float32");
+    auto fir = registry.call("/blocks/opencl_fir_decimator", "0:0", "float32");
+    fir.call("setTaps", std::vector<double>{1.0, 2.0, 3.0});
+    fir.call("setDecimation", 2);
+
+    //several buffers so that the history crosses launches
+    float value = 0;
+    for (size_t n = 0; n < 4; n++)
+    {
+        auto b = Pothos::BufferChunk("float32", 16);
+        auto p = b.as<float *>();
+        for (size_t i = 0; i < 16; i++) p[i] = value++;
+        feeder.call("feedBuffer", b);
+    }
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, fir, 0);
+        topology.connect(fir, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //output m is taps convolved with the input at 2m, starting from zeros
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 32*sizeof(float));
+    auto pb = buff.as<const float *>();
+    for (int m = 0; m < 32; m++)
+    {
+        const int n = 2*m;
+        POTHOS_TEST_CLOSE(pb[m], float(1*n + 2*std::max(n-1, 0) + 3*std::max(n-2, 0)), 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_fir_decimator_rounding)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "float32");
+    auto feeder = registry.call("/blocks/feeder_source", "float32");
+    auto fir = registry.call("/blocks/opencl_fir_decimator", "0:0", "float32");
+
+    //1/49 is not exact in floating point, 98*(1.0/49) < 2
+    const size_t decim = 49;
+    fir.call("setDecimation", decim);
+
+    auto b = Pothos::BufferChunk("float32", decim*20);
+    auto p = b.as<float *>();
+    for (size_t i = 0; i < decim*20; i++) p[i] = float(i);
+    feeder.call("feedBuffer", b);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, fir, 0);
+        topology.connect(fir, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //single unit tap: output m is the input at decim*m
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 20*sizeof(float));
+    auto pb = buff.as<const float *>();
+    for (size_t m = 0; m < 20; m++) POTHOS_TEST_CLOSE(pb[m], float(decim*m), 1e-3);
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_fir_decimator_complex)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+    auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+    auto fir = registry.call("/blocks/opencl_fir_decimator", "0:0", "complex_float32");
+    const size_t decim = 49;
+    fir.call("setDecimation", decim);
+
+    //a partial decimation period is left over at the end
+    const size_t numInputs = decim*20 + 3;
+    auto b = Pothos::BufferChunk("complex_float32", numInputs);
+    auto p = b.as<std::complex<float> *>();
+    for (size_t i = 0; i < numInputs; i++) p[i] = std::complex<float>(float(i), -float(i%7));
+    feeder.call("feedBuffer", b);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, fir, 0);
+        topology.connect(fir, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 20*sizeof(std::complex<float>));
+    auto pb = buff.as<const std::complex<float> *>();
+    for (size_t m = 0; m < 20; m++)
+    {
+        POTHOS_TEST_CLOSE(pb[m].real(), p[decim*m].real(), 1e-3);
+        POTHOS_TEST_CLOSE(pb[m].imag(), p[decim*m].imag(), 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_magnitude)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+
+    //not a multiple of the vector width, the last work-item processes the remainder
+    auto b = Pothos::BufferChunk("complex_float32", 18);
+    auto p = b.as<std::complex<float> *>();
+    for (size_t i = 0; i < 18; i++) p[i] = std::complex<float>(float(i), 2.0f);
+
+    for (const std::string mode : {"MAGNITUDE", "POWER", "POWER_DB"})
+    {
+        auto collector = registry.call("/blocks/collector_sink", "float32");
+        auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+        auto magnitude = registry.call("/blocks/opencl_magnitude", "0:0");
+        magnitude.call("setMode", mode);
+        feeder.call("feedBuffer", b);
+
+        {
+            Pothos::Topology topology;
+            topology.connect(feeder, 0, magnitude, 0);
+            topology.connect(magnitude, 0, collector, 0);
+            topology.commit();
+            POTHOS_TEST_TRUE(topology.waitInactive());
+        }
+
+        Pothos::BufferChunk buff = collector.call("getBuffer");
+        POTHOS_TEST_EQUAL(buff.length, 18*sizeof(float));
+        auto pb = buff.as<const float *>();
+        for (size_t i = 0; i < 18; i++)
+        {
+            const auto power = std::norm(p[i]);
+            if (mode == "MAGNITUDE") POTHOS_TEST_CLOSE(pb[i], std::sqrt(power), 1e-3);
+            if (mode == "POWER") POTHOS_TEST_CLOSE(pb[i], power, 1e-2);
+            if (mode == "POWER_DB") POTHOS_TEST_CLOSE(pb[i], 10*std::log10(power), 1e-3);
+        }
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_freq_shift)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+    auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+    auto shift = registry.call("/blocks/opencl_freq_shift", "0:0");
+    shift.call("setSampleRate", 1e6);
+    shift.call("setFrequency", 250e3);
+
+    //two buffers so the phase carries across launches,
+    //the total is not a multiple of the vector width
+    std::vector<std::complex<float>> input;
+    for (const size_t length : {18, 19})
+    {
+        auto b = Pothos::BufferChunk("complex_float32", length);
+        auto p = b.as<std::complex<float> *>();
+        for (size_t i = 0; i < length; i++)
+        {
+            p[i] = std::complex<float>(1.0f + input.size(), 0.5f);
+            input.push_back(p[i]);
+        }
+        feeder.call("feedBuffer", b);
+    }
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, shift, 0);
+        topology.connect(shift, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //a quarter of the sample rate advances a quarter cycle per sample
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 37*sizeof(std::complex<float>));
+    auto pb = buff.as<const std::complex<float> *>();
+    for (size_t n = 0; n < 37; n++)
+    {
+        const auto expected = input[n]*std::polar(1.0f, float(M_PI/2*(n%4)));
+        POTHOS_TEST_CLOSE(pb[n].real(), expected.real(), 1e-3);
+        POTHOS_TEST_CLOSE(pb[n].imag(), expected.imag(), 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_convert)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "int16");
+    auto feeder = registry.call("/blocks/feeder_source", "float32");
+    auto convert = registry.call("/blocks/opencl_convert", "0:0", "float32", "int16");
+    convert.call("setScale", 10000.0);
+
+    //eight scalars per work-item, the last work-item converts the remainder
+    auto b = Pothos::BufferChunk("float32", 21);
+    auto p = b.as<float *>();
+    for (size_t i = 0; i < 21; i++) p[i] = (float(i)-10.0f)*0.37f;
+    feeder.call("feedBuffer", b);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, convert, 0);
+        topology.connect(convert, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //rounded and saturated to the output type
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 21*sizeof(short));
+    auto pb = buff.as<const short *>();
+    for (size_t i = 0; i < 21; i++)
+    {
+        const auto expected = std::max(-32768.0, std::min(32767.0, std::round(p[i]*10000.0)));
+        POTHOS_TEST_TRUE(std::abs(pb[i] - expected) <= 1.0);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_fft)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+    auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+    auto fft = registry.call("/blocks/opencl_fft", "0:0", 32);
+
+    //an impulse, then a tone in bin 3, then a partial frame that is not consumed
+    auto b = Pothos::BufferChunk("complex_float32", 80);
+    auto p = b.as<std::complex<float> *>();
+    for (size_t i = 0; i < 80; i++) p[i] = 0.0f;
+    p[0] = 1.0f;
+    const double twoPi = 8*std::atan(1.0);
+    for (size_t i = 0; i < 32; i++) p[32+i] = std::polar(1.0f, float(twoPi*3*i/32));
+    feeder.call("feedBuffer", b);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, fft, 0);
+        topology.connect(fft, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 64*sizeof(std::complex<float>));
+    auto pb = buff.as<const std::complex<float> *>();
+    for (size_t i = 0; i < 32; i++)
+    {
+        POTHOS_TEST_CLOSE(pb[i].real(), 1.0f, 1e-3);
+        POTHOS_TEST_CLOSE(pb[i].imag(), 0.0f, 1e-3);
+        POTHOS_TEST_CLOSE(pb[32+i].real(), (i == 3)?32.0f:0.0f, 1e-3);
+        POTHOS_TEST_CLOSE(pb[32+i].imag(), 0.0f, 1e-3);
+    }
+}
+
+POTHOS_TEST_BLOCK("/opencl/tests", test_opencl_fft_inverse)
+{
+    auto registry = Pothos::ProxyEnvironment::make("managed")->findProxy("Pothos/BlockRegistry");
+    auto collector = registry.call("/blocks/collector_sink", "complex_float32");
+    auto tap = registry.call("/blocks/collector_sink", "complex_float32");
+    auto feeder = registry.call("/blocks/feeder_source", "complex_float32");
+
+    //64 is an even power of two, so only radix-4 stages run
+    auto forward = registry.call("/blocks/opencl_fft", "0:0", 64);
+    auto inverse = registry.call("/blocks/opencl_fft", "0:0", 64);
+    inverse.call("setInverse", true);
+    POTHOS_TEST_TRUE(inverse.call<bool>("getInverse"));
+
+    auto b = Pothos::BufferChunk("complex_float32", 3*64);
+    auto p = b.as<std::complex<float> *>();
+    for (size_t i = 0; i < 3*64; i++) p[i] = std::complex<float>(std::sin(0.7f*i), std::cos(1.3f*i));
+    feeder.call("feedBuffer", b);
+
+    {
+        Pothos::Topology topology;
+        topology.connect(feeder, 0, forward, 0);
+        topology.connect(forward, 0, inverse, 0);
+        topology.connect(forward, 0, tap, 0);
+        topology.connect(inverse, 0, collector, 0);
+        topology.commit();
+        POTHOS_TEST_TRUE(topology.waitInactive());
+    }
+
+    //the forward transform matches a direct DFT of each frame
+    const double twoPi = 8*std::atan(1.0);
+    Pothos::BufferChunk spectrum = tap.call("getBuffer");
+    POTHOS_TEST_EQUAL(spectrum.length, 3*64*sizeof(std::complex<float>));
+    auto ps = spectrum.as<const std::complex<float> *>();
+    for (size_t f = 0; f < 3; f++)
+    {
+        for (size_t k = 0; k < 64; k++)
+        {
+            std::complex<double> expected = 0.0;
+            for (size_t n = 0; n < 64; n++) expected += std::complex<double>(p[f*64+n])*std::polar(1.0, -twoPi*k*n/64);
+            POTHOS_TEST_CLOSE(ps[f*64+k].real(), expected.real(), 1e-2);
+            POTHOS_TEST_CLOSE(ps[f*64+k].imag(), expected.imag(), 1e-2);
+        }
+    }
+
+    //the transforms are unnormalized, the round trip scales by the size
+    Pothos::BufferChunk buff = collector.call("getBuffer");
+    POTHOS_TEST_EQUAL(buff.length, 3*64*sizeof(std::complex<float>));
+    auto pb = buff.as<const std::complex<float> *>();
+    for (size_t i = 0; i < 3*64; i++)
+    {
+        POTHOS_TEST_CLOSE(pb[i].real(), 64*p[i].real(), 1e-2);
+        POTHOS_TEST_CLOSE(pb[i].imag(), 64*p[i].imag(), 1e-2);
+    }
+}